@@ -0,0 +1,253 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "event-loop.h"
+
+#define EVENT_LOOP_MAX_EVENTS 16
+
+static void _event_loop_timer_cb (int fd, uint32_t events, void *arg) {
+	EventLoop *loop = (EventLoop *) arg;
+	uint64_t expirations;
+	
+	if (read (fd, &expirations, sizeof (expirations)) < 0) {
+		/* EAGAIN, alguien ya lo leyó */
+	}
+	
+	loop->is_armed = 0;
+	
+	timers_run (loop->timers);
+}
+
+static void _event_loop_signal_cb (int fd, uint32_t events, void *arg) {
+	EventLoop *loop = (EventLoop *) arg;
+	struct signalfd_siginfo info;
+	int signum;
+	
+	while (read (fd, &info, sizeof (info)) == sizeof (info)) {
+		signum = info.ssi_signo;
+		
+		if (signum < EVENT_LOOP_MAX_SIGNALS && loop->signal_cbs[signum] != NULL) {
+			loop->signal_cbs[signum] (signum, loop->signal_args[signum]);
+		}
+	}
+}
+
+static void _event_loop_arm_timer (EventLoop *loop) {
+	struct itimerspec spec;
+	struct timespec deadline;
+	
+	memset (&spec, 0, sizeof (spec));
+	
+	if (timers_next_deadline (loop->timers, &deadline) == 0) {
+		/* Nada programado, desarmar si estaba armado */
+		if (loop->is_armed == 0) return;
+		
+		loop->is_armed = 0;
+	} else {
+		if (loop->is_armed && timespec_cmp (deadline, loop->armed) == 0) return;
+		
+		/* Un it_value en cero desarma el timer, así que un deadline vencido se adelanta a 1 ns */
+		if (deadline.tv_sec == 0 && deadline.tv_nsec == 0) deadline.tv_nsec = 1;
+		
+		spec.it_value = deadline;
+		loop->armed = deadline;
+		loop->is_armed = 1;
+	}
+	
+	if (timerfd_settime (loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+		perror ("timerfd_settime");
+	}
+}
+
+static void _event_loop_free_dead (EventLoop *loop) {
+	g_list_free_full (loop->dead_watches, (GDestroyNotify) free);
+	loop->dead_watches = NULL;
+}
+
+int event_loop_init (EventLoop *loop, TimerQueue *timers) {
+	memset (loop, 0, sizeof (EventLoop));
+	
+	loop->timer_fd = loop->signal_fd = -1;
+	loop->timers = timers;
+	sigemptyset (&loop->signals);
+	
+	loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+	
+	if (loop->epoll_fd < 0) {
+		perror ("epoll_create1");
+		
+		return -1;
+	}
+	
+	loop->timer_fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	
+	if (loop->timer_fd < 0) {
+		perror ("timerfd_create");
+		close (loop->epoll_fd);
+		
+		return -1;
+	}
+	
+	if (event_loop_add_fd (loop, loop->timer_fd, EPOLLIN, _event_loop_timer_cb, loop) == NULL) {
+		close (loop->timer_fd);
+		close (loop->epoll_fd);
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+void event_loop_destroy (EventLoop *loop) {
+	g_list_free_full (loop->watches, (GDestroyNotify) free);
+	loop->watches = NULL;
+	
+	_event_loop_free_dead (loop);
+	
+	if (loop->signal_fd >= 0) {
+		close (loop->signal_fd);
+		sigprocmask (SIG_UNBLOCK, &loop->signals, NULL);
+	}
+	
+	close (loop->timer_fd);
+	close (loop->epoll_fd);
+	
+	loop->signal_fd = loop->timer_fd = loop->epoll_fd = -1;
+}
+
+EventLoopWatch *event_loop_add_fd (EventLoop *loop, int fd, uint32_t events, EventLoopFdCB cb, void *arg) {
+	EventLoopWatch *watch;
+	struct epoll_event ev;
+	
+	watch = (EventLoopWatch *) malloc (sizeof (EventLoopWatch));
+	
+	if (watch == NULL) {
+		return NULL;
+	}
+	
+	watch->fd = fd;
+	watch->cb = cb;
+	watch->arg = arg;
+	
+	memset (&ev, 0, sizeof (ev));
+	ev.events = events;
+	ev.data.ptr = watch;
+	
+	if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		perror ("epoll_ctl ADD");
+		free (watch);
+		
+		return NULL;
+	}
+	
+	loop->watches = g_list_append (loop->watches, watch);
+	
+	return watch;
+}
+
+void event_loop_remove_fd (EventLoop *loop, EventLoopWatch *watch) {
+	if (watch == NULL || watch->fd < 0) return;
+	
+	epoll_ctl (loop->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+	
+	/* Puede haber eventos pendientes de este watch en el lote actual,
+	 * así que se libera hasta terminar la iteración */
+	watch->fd = -1;
+	loop->watches = g_list_remove (loop->watches, watch);
+	loop->dead_watches = g_list_prepend (loop->dead_watches, watch);
+}
+
+int event_loop_add_signal (EventLoop *loop, int signum, EventLoopSignalCB cb, void *arg) {
+	int fd;
+	
+	if (signum <= 0 || signum >= EVENT_LOOP_MAX_SIGNALS) {
+		return -1;
+	}
+	
+	sigaddset (&loop->signals, signum);
+	
+	/* Bloquear la señal para que solo llegue por el signalfd */
+	if (sigprocmask (SIG_BLOCK, &loop->signals, NULL) < 0) {
+		perror ("sigprocmask");
+		
+		return -1;
+	}
+	
+	fd = signalfd (loop->signal_fd, &loop->signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	
+	if (fd < 0) {
+		perror ("signalfd");
+		
+		return -1;
+	}
+	
+	if (loop->signal_fd < 0) {
+		loop->signal_fd = fd;
+		
+		if (event_loop_add_fd (loop, fd, EPOLLIN, _event_loop_signal_cb, loop) == NULL) {
+			close (fd);
+			loop->signal_fd = -1;
+			
+			return -1;
+		}
+	}
+	
+	loop->signal_cbs[signum] = cb;
+	loop->signal_args[signum] = arg;
+	
+	return 0;
+}
+
+void event_loop_set_iteration_func (EventLoop *loop, EventLoopHookCB cb, void *arg) {
+	loop->iteration_cb = cb;
+	loop->iteration_arg = arg;
+}
+
+void event_loop_run (EventLoop *loop) {
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	EventLoopWatch *watch;
+	int g, res;
+	
+	loop->running = 1;
+	
+	while (loop->running) {
+		_event_loop_arm_timer (loop);
+		
+		res = epoll_wait (loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, -1);
+		
+		if (res < 0) {
+			if (errno == EINTR) continue;
+			
+			perror ("epoll_wait");
+			break;
+		}
+		
+		for (g = 0; g < res; g++) {
+			watch = (EventLoopWatch *) events[g].data.ptr;
+			
+			/* Eliminado por un callback anterior en este mismo lote */
+			if (watch->fd < 0) continue;
+			
+			watch->cb (watch->fd, events[g].events, watch->arg);
+		}
+		
+		if (loop->iteration_cb != NULL) {
+			loop->iteration_cb (loop->iteration_arg);
+		}
+		
+		_event_loop_free_dead (loop);
+	}
+}
+
+void event_loop_quit (EventLoop *loop) {
+	loop->running = 0;
+}
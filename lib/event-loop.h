@@ -0,0 +1,58 @@
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include <stdint.h>
+#include <signal.h>
+
+#include "glist.h"
+#include "timers.h"
+
+#define EVENT_LOOP_MAX_SIGNALS 65
+
+typedef void (*EventLoopFdCB) (int fd, uint32_t events, void *arg);
+typedef void (*EventLoopSignalCB) (int signum, void *arg);
+typedef void (*EventLoopHookCB) (void *arg);
+
+typedef struct _EventLoopWatch {
+	int fd;
+	EventLoopFdCB cb;
+	void *arg;
+} EventLoopWatch;
+
+typedef struct {
+	int epoll_fd;
+	
+	/* Los timers se despiertan con un timerfd armado al deadline más próximo */
+	int timer_fd;
+	TimerQueue *timers;
+	struct timespec armed;
+	int is_armed;
+	
+	/* Las señales llegan como lecturas del signalfd */
+	int signal_fd;
+	sigset_t signals;
+	EventLoopSignalCB signal_cbs[EVENT_LOOP_MAX_SIGNALS];
+	void *signal_args[EVENT_LOOP_MAX_SIGNALS];
+	
+	GList *watches;
+	GList *dead_watches;
+	
+	/* Se llama después de despachar cada lote de eventos */
+	EventLoopHookCB iteration_cb;
+	void *iteration_arg;
+	
+	int running;
+} EventLoop;
+
+int event_loop_init (EventLoop *loop, TimerQueue *timers);
+void event_loop_destroy (EventLoop *loop);
+
+EventLoopWatch *event_loop_add_fd (EventLoop *loop, int fd, uint32_t events, EventLoopFdCB cb, void *arg);
+void event_loop_remove_fd (EventLoop *loop, EventLoopWatch *watch);
+int event_loop_add_signal (EventLoop *loop, int signum, EventLoopSignalCB cb, void *arg);
+void event_loop_set_iteration_func (EventLoop *loop, EventLoopHookCB cb, void *arg);
+
+void event_loop_run (EventLoop *loop);
+void event_loop_quit (EventLoop *loop);
+
+#endif /* __EVENT_LOOP_H__ */
@@ -30,6 +30,7 @@
 #include "netwatcher.h"
 #include "interfaces.h"
 #include "ip-address.h"
+#include "netlink-events.h"
 
 static int _interfaces_receive_message_interface (struct nl_msg *msg, void *arg, int first_time);
 
@@ -155,6 +156,8 @@ static int _interfaces_receive_message_interface (struct nl_msg *msg, void *arg,
 		if (handle->interface_added_cb != NULL) {
 			handle->interface_added_cb (iface, handle->cb_arg);
 		}
+		
+		netlink_events_record_change (handle, NETWORK_CHANGE_INTERFACE_ADDED, iface, NULL);
 	} else if (was_new == 0 && up_down != 0) {
 		/* Disparar el evento de interfaz up o down */
 		if (up_down == 1) {
@@ -162,11 +165,15 @@ static int _interfaces_receive_message_interface (struct nl_msg *msg, void *arg,
 			if (handle->interface_down_cb != NULL) {
 				handle->interface_down_cb (iface, handle->cb_arg);
 			}
+			
+			netlink_events_record_change (handle, NETWORK_CHANGE_INTERFACE_DOWN, iface, NULL);
 		} else if (up_down == 2) {
 			/* Interfaz activa */
 			if (handle->interface_up_cb != NULL) {
 				handle->interface_up_cb (iface, handle->cb_arg);
 			}
+			
+			netlink_events_record_change (handle, NETWORK_CHANGE_INTERFACE_UP, iface, NULL);
 		}
 	}
 	
@@ -328,6 +335,8 @@ int interface_receive_message_dellink (struct nl_msg *msg, void *arg) {
 		handle->interface_deleted_cb (iface, handle->cb_arg);
 	}
 	
+	netlink_events_record_change (handle, NETWORK_CHANGE_INTERFACE_DELETED, iface, NULL);
+	
 	/* Antes de eliminar la interfaz, eliminar la lista ligada de todas las direcciones IP */
 	g_list_free_full (iface->address, free);
 	
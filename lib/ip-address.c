@@ -31,6 +31,7 @@
 #include "netwatcher.h"
 #include "ip-address.h"
 #include "interfaces.h"
+#include "netlink-events.h"
 
 static IPAddr *_ip_address_search_addr (Interface *iface, sa_family_t family, void *addr_data, uint32_t prefix) {
 	GList *g;
@@ -135,6 +136,8 @@ static int _ip_address_receive_message_address (struct nl_msg *msg, void *arg, i
 		if (handle->ip_address_added_cb != NULL) {
 			handle->ip_address_added_cb (iface, addr, handle->cb_arg);
 		}
+		
+		netlink_events_record_change (handle, NETWORK_CHANGE_ADDRESS_ADDED, iface, addr);
 	}
 	
 	return NL_SKIP;
@@ -195,6 +198,8 @@ int ip_address_receive_message_deladdr (struct nl_msg *msg, void *arg) {
 		handle->ip_address_deleted_cb (iface, addr, handle->cb_arg);
 	}
 	
+	netlink_events_record_change (handle, NETWORK_CHANGE_ADDRESS_DELETED, iface, addr);
+	
 	free (addr);
 	
 	return NL_SKIP;
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency-histogram.h"
+
+void latency_histogram_init (LatencyHistogram *hist) {
+	memset (hist, 0, sizeof (LatencyHistogram));
+}
+
+void latency_histogram_add (LatencyHistogram *hist, long usec) {
+	int bucket;
+	
+	if (usec < 0) usec = 0;
+	
+	/* Cubeta 0 para menos de 1 us, si no 1 + log2 */
+	if (usec == 0) {
+		bucket = 0;
+	} else {
+		bucket = 64 - __builtin_clzl ((unsigned long) usec);
+		if (bucket >= LATENCY_HISTOGRAM_BUCKETS) bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+	}
+	
+	hist->buckets[bucket]++;
+	hist->count++;
+	
+	if (usec > hist->max_usec) hist->max_usec = usec;
+}
+
+/* Agrega el tiempo entre "start" y "end", del mismo reloj */
+void latency_histogram_add_since (LatencyHistogram *hist, struct timespec start, struct timespec end) {
+	long usec;
+	
+	usec = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L;
+	
+	latency_histogram_add (hist, usec);
+}
+
+void latency_histogram_print (LatencyHistogram *hist, FILE *stream, const char *title) {
+	int g;
+	
+	fprintf (stream, "%s: %lu muestras, máximo %ld us\n", title, hist->count, hist->max_usec);
+	
+	for (g = 0; g < LATENCY_HISTOGRAM_BUCKETS; g++) {
+		if (hist->buckets[g] == 0) continue;
+		
+		if (g == LATENCY_HISTOGRAM_BUCKETS - 1) {
+			fprintf (stream, "  >= %lu us: %lu\n", 1UL << (g - 1), hist->buckets[g]);
+		} else if (g == 0) {
+			fprintf (stream, "  < 1 us: %lu\n", hist->buckets[g]);
+		} else {
+			fprintf (stream, "  < %lu us: %lu\n", 1UL << g, hist->buckets[g]);
+		}
+	}
+}
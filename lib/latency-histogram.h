@@ -0,0 +1,22 @@
+#ifndef __LATENCY_HISTOGRAM_H__
+#define __LATENCY_HISTOGRAM_H__
+
+#include <stdio.h>
+#include <time.h>
+
+/* Cubetas en potencias de 2 de microsegundos: [0, 1), [1, 2), [2, 4) ... la última junta todo lo demás */
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+typedef struct {
+	unsigned long buckets[LATENCY_HISTOGRAM_BUCKETS];
+	
+	unsigned long count;
+	long max_usec;
+} LatencyHistogram;
+
+void latency_histogram_init (LatencyHistogram *hist);
+void latency_histogram_add (LatencyHistogram *hist, long usec);
+void latency_histogram_add_since (LatencyHistogram *hist, struct timespec start, struct timespec end);
+void latency_histogram_print (LatencyHistogram *hist, FILE *stream, const char *title);
+
+#endif /* __LATENCY_HISTOGRAM_H__ */
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lsa-arrival.h"
+
+/* Las entradas que no reciben nada en este tiempo (MaxAge) se descartan */
+#define LSA_ARRIVAL_STALE_MSEC (3600 * 1000L)
+
+/* Cada cuánto se recorre toda la tabla buscando entradas viejas */
+#define LSA_ARRIVAL_SWEEP_MSEC (60 * 1000L)
+
+static unsigned int _lsa_arrival_hash (uint32_t type, uint32_t link_state_id, uint32_t advert_router) {
+	uint32_t h;
+	
+	h = type * 0x9E3779B1u;
+	h ^= link_state_id + 0x7F4A7C15u + (h << 6) + (h >> 2);
+	h ^= advert_router + 0x7F4A7C15u + (h << 6) + (h >> 2);
+	
+	return h % LSA_ARRIVAL_BUCKETS;
+}
+
+static long _lsa_arrival_elapsed (struct timespec *since, struct timespec *now) {
+	return (now->tv_sec - since->tv_sec) * 1000 + (now->tv_nsec - since->tv_nsec) / 1000000;
+}
+
+void lsa_arrival_init (LSAArrivalTable *table, long min_arrival_msec) {
+	memset (table, 0, sizeof (LSAArrivalTable));
+	
+	table->min_arrival_msec = min_arrival_msec;
+	clock_gettime (CLOCK_MONOTONIC, &table->last_sweep);
+}
+
+void lsa_arrival_destroy (LSAArrivalTable *table) {
+	LSAArrival *entry, *next;
+	int g;
+	
+	for (g = 0; g < LSA_ARRIVAL_BUCKETS; g++) {
+		for (entry = table->buckets[g]; entry != NULL; entry = next) {
+			next = entry->next;
+			free (entry);
+		}
+		
+		table->buckets[g] = NULL;
+	}
+	
+	table->count = 0;
+}
+
+/* Suelta de toda la tabla las entradas sin llegadas en "max_msec" */
+static void _lsa_arrival_sweep (LSAArrivalTable *table, struct timespec *now, long max_msec) {
+	LSAArrival *entry, **prev;
+	int g;
+	
+	for (g = 0; g < LSA_ARRIVAL_BUCKETS; g++) {
+		prev = &table->buckets[g];
+		while (*prev != NULL) {
+			entry = *prev;
+			
+			if (_lsa_arrival_elapsed (&entry->last, now) >= max_msec) {
+				*prev = entry->next;
+				free (entry);
+				table->count--;
+				continue;
+			}
+			
+			prev = &entry->next;
+		}
+	}
+	
+	table->last_sweep = *now;
+}
+
+/* Registra la llegada de una instancia de LSA.
+ * Una retransmisión de la misma instancia es un duplicado, se puede confirmar sin procesar.
+ * Una instancia más vieja que la registrada no cuenta como llegada, la entrada no cambia.
+ * Una instancia más nueva que llega antes de MinLSArrival desde la anterior se debe descartar sin ACK */
+int lsa_arrival_check (LSAArrivalTable *table, uint32_t type, uint32_t link_state_id, uint32_t advert_router, uint32_t seq_num) {
+	LSAArrival *entry;
+	struct timespec now;
+	unsigned int bucket;
+	
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	
+	if (_lsa_arrival_elapsed (&table->last_sweep, &now) >= LSA_ARRIVAL_SWEEP_MSEC) {
+		_lsa_arrival_sweep (table, &now, LSA_ARRIVAL_STALE_MSEC);
+	}
+	
+	bucket = _lsa_arrival_hash (type, link_state_id, advert_router);
+	
+	for (entry = table->buckets[bucket]; entry != NULL; entry = entry->next) {
+		if (entry->type == type && entry->link_state_id == link_state_id && entry->advert_router == advert_router) {
+			break;
+		}
+	}
+	
+	if (entry != NULL) {
+		/* Los números de secuencia se comparan con signo, como en lsa_more_recent */
+		if ((int32_t) seq_num == (int32_t) entry->seq_num) {
+			table->duplicates++;
+			
+			return LSA_ARRIVAL_DUPLICATE;
+		}
+		
+		if ((int32_t) seq_num < (int32_t) entry->seq_num) {
+			table->older++;
+			
+			return LSA_ARRIVAL_OLDER;
+		}
+		
+		if (_lsa_arrival_elapsed (&entry->last, &now) < table->min_arrival_msec) {
+			table->dropped++;
+			
+			return LSA_ARRIVAL_TOO_SOON;
+		}
+		
+		entry->seq_num = seq_num;
+		entry->last = now;
+		table->accepted++;
+		
+		return LSA_ARRIVAL_ACCEPT;
+	}
+	
+	if (table->count >= LSA_ARRIVAL_MAX_ENTRIES) {
+		/* Tabla llena, las entradas más viejas que MinLSArrival ya no pueden provocar un descarte */
+		_lsa_arrival_sweep (table, &now, table->min_arrival_msec);
+	}
+	
+	table->accepted++;
+	
+	if (table->count >= LSA_ARRIVAL_MAX_ENTRIES) {
+		/* Sigue llena, aceptar sin registrar */
+		return LSA_ARRIVAL_ACCEPT;
+	}
+	
+	entry = (LSAArrival *) malloc (sizeof (LSAArrival));
+	
+	if (entry != NULL) {
+		entry->type = type;
+		entry->link_state_id = link_state_id;
+		entry->advert_router = advert_router;
+		entry->seq_num = seq_num;
+		entry->last = now;
+		
+		entry->next = table->buckets[bucket];
+		table->buckets[bucket] = entry;
+		table->count++;
+	}
+	
+	return LSA_ARRIVAL_ACCEPT;
+}
@@ -0,0 +1,47 @@
+#ifndef __LSA_ARRIVAL_H__
+#define __LSA_ARRIVAL_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#define LSA_ARRIVAL_BUCKETS 256
+
+/* Máximo de LSA distintos que se registran a la vez */
+#define LSA_ARRIVAL_MAX_ENTRIES 8192
+
+/* Resultado de registrar la llegada de una instancia */
+#define LSA_ARRIVAL_ACCEPT    0
+#define LSA_ARRIVAL_DUPLICATE 1
+#define LSA_ARRIVAL_TOO_SOON  2
+#define LSA_ARRIVAL_OLDER     3
+
+typedef struct _LSAArrival {
+	uint32_t type;
+	uint32_t link_state_id;
+	uint32_t advert_router;
+	
+	/* Última instancia aceptada de este LSA */
+	uint32_t seq_num;
+	struct timespec last;
+	
+	struct _LSAArrival *next;
+} LSAArrival;
+
+/* Última llegada de cada LSA (tipo, id, router), para aplicar MinLSArrival */
+typedef struct {
+	LSAArrival *buckets[LSA_ARRIVAL_BUCKETS];
+	long min_arrival_msec;
+	int count;
+	struct timespec last_sweep;
+	
+	unsigned long accepted;
+	unsigned long duplicates;
+	unsigned long older;
+	unsigned long dropped;
+} LSAArrivalTable;
+
+void lsa_arrival_init (LSAArrivalTable *table, long min_arrival_msec);
+void lsa_arrival_destroy (LSAArrivalTable *table);
+int lsa_arrival_check (LSAArrivalTable *table, uint32_t type, uint32_t link_state_id, uint32_t advert_router, uint32_t seq_num);
+
+#endif /* __LSA_ARRIVAL_H__ */
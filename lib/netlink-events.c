@@ -20,13 +20,26 @@
  * Boston, MA  02110-1301  USA
  */
 
+#include <string.h>
+#include <errno.h>
+
 #include <netlink/socket.h>
 #include <netlink/msg.h>
+#include <netlink/handlers.h>
 
 #include "netwatcher.h"
+#include "netlink-events.h"
 #include "interfaces.h"
 #include "ip-address.h"
 
+#define NETLINK_URING_BUFFERS     16
+#define NETLINK_URING_BUFFER_SIZE 16384
+#define NETLINK_URING_BGID        2
+
+/* Datos ya leídos por io_uring, que libnl consume a través de _netlink_events_uring_recv */
+static unsigned char *_netlink_uring_data = NULL;
+static int _netlink_uring_len = 0;
+
 static int _netlink_events_route_dispatcher (struct nl_msg *msg, void *arg) {
 	struct nlmsghdr *reply;
 	
@@ -95,10 +108,157 @@ void netlink_events_interface_down_func (NetworkWatcher *handler, InterfaceCB cb
 	handler->interface_down_cb = cb;
 }
 
+void netlink_events_changes_settled_func (NetworkWatcher *handler, NetworkChangesCB cb) {
+	handler->changes_settled_cb = cb;
+}
+
 void netlink_events_ip_address_arg (NetworkWatcher *handler, void *arg) {
 	handler->cb_arg = arg;
 }
 
+void netlink_events_record_change (NetworkWatcher *handle, int type, Interface *iface, IPAddr *addr) {
+	NetworkChange *change;
+	
+	/* Si nadie escucha los cambios agrupados, no guardar nada */
+	if (handle->changes_settled_cb == NULL) return;
+	
+	change = (NetworkChange *) calloc (1, sizeof (NetworkChange));
+	
+	if (change == NULL) return;
+	
+	change->type = type;
+	change->ifindex = iface->index;
+	
+	if (addr != NULL) {
+		memcpy (&change->addr, addr, sizeof (IPAddr));
+	}
+	
+	handle->pending_changes = g_list_prepend (handle->pending_changes, change);
+}
+
+/* Entregar en una sola llamada todos los cambios acumulados */
+void netlink_events_settle (NetworkWatcher *handle) {
+	GList *changes;
+	
+	if (handle->pending_changes != NULL) {
+		changes = g_list_reverse (handle->pending_changes);
+		handle->pending_changes = NULL;
+		
+		if (handle->changes_settled_cb != NULL) {
+			handle->changes_settled_cb (changes, handle->cb_arg);
+		}
+		
+		g_list_free_full (changes, free);
+	}
+}
+
+/* Leer todos los mensajes pendientes del socket de eventos,
+ * y después entregar todos los cambios en una sola llamada.
+ * libnl lee un datagrama por llamada, el socket es no-bloqueante
+ * así que se lee hasta que no quede nada (-NLE_AGAIN) */
+int netlink_events_drain (NetworkWatcher *handle) {
+	int res;
+	
+	do {
+		res = nl_recvmsgs_default (handle->nl_sock_route_events);
+	} while (res == 0);
+	
+	netlink_events_settle (handle);
+	
+	if (res == -NLE_AGAIN) return 0;
+	
+	return res;
+}
+
+/* Reemplaza la lectura de libnl: entrega una copia del datagrama que recibió io_uring.
+ * libnl libera el buffer al terminar de procesarlo */
+static int _netlink_events_uring_recv (struct nl_sock *sk, struct sockaddr_nl *nla, unsigned char **buf, struct ucred **creds) {
+	if (_netlink_uring_data == NULL) return 0;
+	
+	*buf = (unsigned char *) malloc (_netlink_uring_len);
+	
+	if (*buf == NULL) return -NLE_NOMEM;
+	
+	memcpy (*buf, _netlink_uring_data, _netlink_uring_len);
+	
+	memset (nla, 0, sizeof (struct sockaddr_nl));
+	nla->nl_family = AF_NETLINK;
+	
+	if (creds != NULL) *creds = NULL;
+	
+	_netlink_uring_data = NULL;
+	
+	return _netlink_uring_len;
+}
+
+int netlink_events_uring_start (NetworkWatcher *handle, URing *ring) {
+	struct nl_cb *cb;
+	
+	if (uring_buffers_init (ring, &handle->uring_buffers, NETLINK_URING_BGID, NETLINK_URING_BUFFERS, NETLINK_URING_BUFFER_SIZE) < 0) {
+		return -1;
+	}
+	
+	if (uring_recv_multishot (ring, handle->fd_sock_route_events, &handle->uring_buffers, URING_TAG (URING_KIND_NETLINK_RECV, 0)) < 0) {
+		uring_buffers_destroy (ring, &handle->uring_buffers);
+		
+		return -1;
+	}
+	
+	/* A partir de aquí libnl ya no lee del socket, procesa lo que le entregue io_uring */
+	cb = nl_socket_get_cb (handle->nl_sock_route_events);
+	nl_cb_overwrite_recv (cb, _netlink_events_uring_recv);
+	nl_cb_put (cb);
+	
+	handle->uring = ring;
+	
+	return 0;
+}
+
+void netlink_events_uring_stop (NetworkWatcher *handle) {
+	struct nl_cb *cb;
+	
+	if (handle->uring == NULL) return;
+	
+	/* Regresar a la lectura normal de libnl */
+	cb = nl_socket_get_cb (handle->nl_sock_route_events);
+	nl_cb_overwrite_recv (cb, NULL);
+	nl_cb_put (cb);
+	
+	uring_buffers_destroy (handle->uring, &handle->uring_buffers);
+	handle->uring = NULL;
+}
+
+/* Procesa una terminación del recv multishot del socket de eventos.
+ * Los cambios quedan acumulados hasta netlink_events_settle */
+void netlink_events_uring_complete (NetworkWatcher *handle, int res, unsigned int flags) {
+	unsigned int bid;
+	
+	if (handle->uring == NULL) return;
+	
+	if (flags & IORING_CQE_F_BUFFER) {
+		bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		
+		if (res > 0) {
+			_netlink_uring_data = uring_buffer_get (&handle->uring_buffers, bid);
+			_netlink_uring_len = res;
+			
+			nl_recvmsgs_default (handle->nl_sock_route_events);
+			_netlink_uring_data = NULL;
+		}
+		
+		uring_buffer_recycle (&handle->uring_buffers, bid);
+	}
+	
+	if (flags & IORING_CQE_F_MORE) return;
+	
+	/* El recv multishot terminó, con -ENOBUFS solo se acabaron los buffers */
+	if (res < 0 && res != -ENOBUFS) {
+		fprintf (stderr, "io_uring recv netlink: %s\n", strerror (-res));
+	}
+	
+	uring_recv_multishot (handle->uring, handle->fd_sock_route_events, &handle->uring_buffers, URING_TAG (URING_KIND_NETLINK_RECV, 0));
+}
+
 void netlink_events_clear (NetworkWatcher *handle) {
 	/* Primero, detener los eventos del source watch */
 	
@@ -34,6 +34,15 @@ void netlink_events_ip_address_added_func (NetworkWatcher *handler, IPAddressCB
 void netlink_events_ip_address_deleted_func (NetworkWatcher *handler, IPAddressCB cb);
 void netlink_events_interface_up_func (NetworkWatcher *handler, InterfaceCB cb);
 void netlink_events_interface_down_func (NetworkWatcher *handler, InterfaceCB cb);
+void netlink_events_changes_settled_func (NetworkWatcher *handler, NetworkChangesCB cb);
 void netlink_events_ip_address_arg (NetworkWatcher *handler, void *arg);
 
+void netlink_events_record_change (NetworkWatcher *handle, int type, Interface *iface, IPAddr *addr);
+int netlink_events_drain (NetworkWatcher *handle);
+void netlink_events_settle (NetworkWatcher *handle);
+
+int netlink_events_uring_start (NetworkWatcher *handle, URing *ring);
+void netlink_events_uring_stop (NetworkWatcher *handle);
+void netlink_events_uring_complete (NetworkWatcher *handle, int res, unsigned int flags);
+
 #endif
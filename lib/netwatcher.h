@@ -13,6 +13,7 @@
 #include <netinet/in.h>
 
 #include "glist.h"
+#include "uring.h"
 
 #ifndef FALSE
 #define FALSE 0
@@ -62,6 +63,24 @@ typedef struct _Interface {
 typedef void (*InterfaceCB) (Interface *, void *);
 typedef void (*IPAddressCB) (Interface *, IPAddr *, void *);
 
+/* Tipos de cambio acumulados durante una lectura del socket de eventos */
+#define NETWORK_CHANGE_INTERFACE_ADDED   1
+#define NETWORK_CHANGE_INTERFACE_DELETED 2
+#define NETWORK_CHANGE_INTERFACE_UP      3
+#define NETWORK_CHANGE_INTERFACE_DOWN    4
+#define NETWORK_CHANGE_ADDRESS_ADDED     5
+#define NETWORK_CHANGE_ADDRESS_DELETED   6
+
+typedef struct {
+	int type;
+	unsigned int ifindex;
+	
+	/* Copia de la dirección, la original puede ya estar liberada */
+	IPAddr addr;
+} NetworkChange;
+
+typedef void (*NetworkChangesCB) (GList *, void *);
+
 typedef struct {
 	GList *interfaces;
 	
@@ -78,6 +97,14 @@ typedef struct {
 	InterfaceCB interface_down_cb;
 	InterfaceCB interface_up_cb;
 	
+	/* Todos los cambios de una lectura, entregados juntos al final */
+	GList *pending_changes;
+	NetworkChangesCB changes_settled_cb;
+	
+	/* Si no es NULL, el socket de eventos se lee con io_uring */
+	URing *uring;
+	URingBufferGroup uring_buffers;
+	
 	void *cb_arg;
 } NetworkWatcher;
 
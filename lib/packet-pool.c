@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "packet-pool.h"
+
+#define PACKET_POOL_ITEM(data) (((PacketPoolItem *) (data)) - 1)
+#define PACKET_POOL_DATA(item) ((void *) ((item) + 1))
+
+void packet_pool_init (PacketPool *pool, size_t size, unsigned int max_free) {
+	memset (pool, 0, sizeof (PacketPool));
+	
+	pool->size = size;
+	pool->max_free = max_free;
+}
+
+void packet_pool_destroy (PacketPool *pool) {
+	PacketPoolItem *item, *next;
+	
+	for (item = pool->free_list; item != NULL; item = next) {
+		next = item->h.next;
+		free (item);
+	}
+	
+	pool->free_list = NULL;
+	pool->free_count = 0;
+}
+
+/* Entrega un buffer con una referencia, sin inicializar */
+void *packet_pool_get (PacketPool *pool) {
+	PacketPoolItem *item;
+	
+	if (pool->free_list != NULL) {
+		item = pool->free_list;
+		pool->free_list = item->h.next;
+		pool->free_count--;
+	} else {
+		item = (PacketPoolItem *) malloc (sizeof (PacketPoolItem) + pool->size);
+		
+		if (item == NULL) {
+			perror ("malloc");
+			
+			return NULL;
+		}
+	}
+	
+	item->h.next = NULL;
+	item->h.pool = pool;
+	item->h.refs = 1;
+	pool->in_use++;
+	
+	return PACKET_POOL_DATA (item);
+}
+
+void *packet_pool_ref (void *data) {
+	PACKET_POOL_ITEM (data)->h.refs++;
+	
+	return data;
+}
+
+void packet_pool_unref (void *data) {
+	PacketPoolItem *item;
+	PacketPool *pool;
+	
+	if (data == NULL) return;
+	
+	item = PACKET_POOL_ITEM (data);
+	item->h.refs--;
+	
+	if (item->h.refs > 0) return;
+	
+	pool = (PacketPool *) item->h.pool;
+	pool->in_use--;
+	
+	if (pool->free_count >= pool->max_free) {
+		free (item);
+		
+		return;
+	}
+	
+	item->h.next = pool->free_list;
+	pool->free_list = item;
+	pool->free_count++;
+}
+
+/* Indica si alguien más tiene una referencia, antes de modificar el buffer */
+int packet_pool_shared (const void *data) {
+	return PACKET_POOL_ITEM (data)->h.refs > 1;
+}
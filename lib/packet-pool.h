@@ -0,0 +1,37 @@
+#ifndef __PACKET_POOL_H__
+#define __PACKET_POOL_H__
+
+#include <stddef.h>
+
+/* Cada buffer lleva esta cabecera antes de los datos, alineada para cualquier tipo */
+typedef union _PacketPoolItem {
+	struct {
+		union _PacketPoolItem *next;
+		void *pool;
+		int refs;
+	} h;
+	max_align_t align;
+} PacketPoolItem;
+
+/* Buffers de tamaño fijo con cuenta de referencias.
+ * Al soltar la última referencia el buffer vuelve a la lista libre, hasta "max_free" buffers */
+typedef struct {
+	size_t size;
+	
+	PacketPoolItem *free_list;
+	unsigned int free_count;
+	unsigned int max_free;
+	
+	/* Buffers entregados que no han vuelto */
+	unsigned int in_use;
+} PacketPool;
+
+void packet_pool_init (PacketPool *pool, size_t size, unsigned int max_free);
+void packet_pool_destroy (PacketPool *pool);
+
+void *packet_pool_get (PacketPool *pool);
+void *packet_pool_ref (void *data);
+void packet_pool_unref (void *data);
+int packet_pool_shared (const void *data);
+
+#endif /* __PACKET_POOL_H__ */
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <linux/if_packet.h>
+
+#include "packet-ring.h"
+
+/* Abrir el socket AF_PACKET y mapear el anillo.
+ * "size" es el tamaño total del anillo en bytes, "timeout_msec" cuánto espera el kernel
+ * antes de entregar un bloque que no se llenó.
+ * El socket empieza descartando todo, hasta que se instale un filtro con packet_ring_set_filter */
+int packet_ring_init (PacketRing *ring, uint16_t ethertype, unsigned int size, unsigned int timeout_msec) {
+	struct tpacket_req3 req;
+	struct sockaddr_ll ll;
+	struct sock_filter drop_all[] = {
+		BPF_STMT (BPF_RET | BPF_K, 0),
+	};
+	int version = TPACKET_V3;
+	int one = 1;
+	
+	memset (ring, 0, sizeof (PacketRing));
+	ring->fd = -1;
+	
+	ring->block_size = PACKET_RING_BLOCK_SIZE;
+	ring->block_count = size / PACKET_RING_BLOCK_SIZE;
+	if (ring->block_count < 2) ring->block_count = 2;
+	
+	/* Protocolo 0: no recibe nada hasta el bind */
+	ring->fd = socket (AF_PACKET, SOCK_DGRAM, 0);
+	
+	if (ring->fd < 0) {
+		perror ("AF_PACKET socket");
+		
+		return -1;
+	}
+	
+	if (setsockopt (ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof (version)) < 0) {
+		perror ("PACKET_VERSION");
+		packet_ring_destroy (ring);
+		
+		return -1;
+	}
+
+#ifdef PACKET_IGNORE_OUTGOING
+	/* Nuestros propios envíos no nos interesan */
+	setsockopt (ring->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof (one));
+#endif
+
+	memset (&req, 0, sizeof (req));
+	req.tp_block_size = ring->block_size;
+	req.tp_block_nr = ring->block_count;
+	req.tp_frame_size = PACKET_RING_FRAME_SIZE;
+	req.tp_frame_nr = (ring->block_size / PACKET_RING_FRAME_SIZE) * ring->block_count;
+	req.tp_retire_blk_tov = timeout_msec;
+	
+	if (setsockopt (ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof (req)) < 0) {
+		perror ("PACKET_RX_RING");
+		packet_ring_destroy (ring);
+		
+		return -1;
+	}
+	
+	ring->map_len = (size_t) ring->block_size * ring->block_count;
+	ring->map = (unsigned char *) mmap (NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, ring->fd, 0);
+	
+	if (ring->map == MAP_FAILED) {
+		/* Sin permiso para bloquear memoria, intentar sin MAP_LOCKED */
+		ring->map = (unsigned char *) mmap (NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+	}
+	
+	if (ring->map == MAP_FAILED) {
+		perror ("mmap PACKET_RX_RING");
+		ring->map = NULL;
+		packet_ring_destroy (ring);
+		
+		return -1;
+	}
+	
+	if (packet_ring_set_filter (ring, drop_all, 1) < 0) {
+		packet_ring_destroy (ring);
+		
+		return -1;
+	}
+	
+	/* Todas las interfaces, el filtro decide cuál nos interesa */
+	memset (&ll, 0, sizeof (ll));
+	ll.sll_family = AF_PACKET;
+	ll.sll_protocol = htons (ethertype);
+	ll.sll_ifindex = 0;
+	
+	if (bind (ring->fd, (struct sockaddr *) &ll, sizeof (ll)) < 0) {
+		perror ("AF_PACKET bind");
+		packet_ring_destroy (ring);
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+void packet_ring_destroy (PacketRing *ring) {
+	if (ring->map != NULL) {
+		munmap (ring->map, ring->map_len);
+		ring->map = NULL;
+	}
+	
+	if (ring->fd >= 0) {
+		close (ring->fd);
+		ring->fd = -1;
+	}
+}
+
+int packet_ring_set_filter (PacketRing *ring, struct sock_filter *code, unsigned short len) {
+	struct sock_fprog prog;
+	
+	prog.len = len;
+	prog.filter = code;
+	
+	if (setsockopt (ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog)) < 0) {
+		perror ("SO_ATTACH_FILTER AF_PACKET");
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Recorre todos los bloques que el kernel ya entregó, llamando a "cb" por cada paquete,
+ * y los devuelve al kernel. Devuelve cuántos paquetes se entregaron */
+int packet_ring_drain (PacketRing *ring, PacketRingCB cb, void *arg) {
+	struct tpacket_block_desc *block;
+	struct tpacket3_hdr *hdr;
+	struct sockaddr_ll *ll;
+	struct timespec stamp;
+	unsigned int g, count;
+	int total = 0;
+	
+	while (1) {
+		block = (struct tpacket_block_desc *) (ring->map + (size_t) ring->current * ring->block_size);
+		
+		if ((__atomic_load_n (&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+			/* El kernel todavía no entrega este bloque */
+			break;
+		}
+		
+		count = block->hdr.bh1.num_pkts;
+		hdr = (struct tpacket3_hdr *) ((unsigned char *) block + block->hdr.bh1.offset_to_first_pkt);
+		
+		for (g = 0; g < count; g++) {
+			ll = (struct sockaddr_ll *) ((unsigned char *) hdr + TPACKET_ALIGN (sizeof (struct tpacket3_hdr)));
+			
+			if (ll->sll_pkttype != PACKET_OUTGOING && ll->sll_pkttype != PACKET_OTHERHOST) {
+				/* Marca de llegada del kernel, CLOCK_REALTIME */
+				stamp.tv_sec = hdr->tp_sec;
+				stamp.tv_nsec = hdr->tp_nsec;
+				
+				cb ((unsigned char *) hdr + hdr->tp_mac, hdr->tp_snaplen, ll->sll_ifindex, &stamp, arg);
+				total++;
+			}
+			
+			hdr = (struct tpacket3_hdr *) ((unsigned char *) hdr + hdr->tp_next_offset);
+		}
+		
+		/* Regresar el bloque al kernel */
+		__atomic_store_n (&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		
+		ring->current = (ring->current + 1) % ring->block_count;
+		ring->blocks++;
+	}
+	
+	ring->packets += total;
+	
+	return total;
+}
+
+/* Paquetes que el kernel no pudo poner en el anillo por estar lleno.
+ * PACKET_STATISTICS se reinicia en cada lectura, aquí se acumula */
+unsigned long packet_ring_drops (PacketRing *ring) {
+	struct tpacket_stats_v3 stats;
+	socklen_t len = sizeof (stats);
+	
+	if (ring->fd >= 0 && getsockopt (ring->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+		ring->drops += stats.tp_drops;
+	}
+	
+	return ring->drops;
+}
@@ -0,0 +1,46 @@
+#ifndef __PACKET_RING_H__
+#define __PACKET_RING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+
+/* Tamaño de cada bloque del anillo, múltiplo del tamaño de página */
+#define PACKET_RING_BLOCK_SIZE (64 * 1024)
+#define PACKET_RING_FRAME_SIZE 2048
+
+/* Límites para la línea de comandos: 256 MiB y 10 segundos */
+#define PACKET_RING_MAX_SIZE_KIB (256 * 1024)
+#define PACKET_RING_MAX_TIMEOUT  10000
+
+typedef void (*PacketRingCB) (unsigned char *data, unsigned int len, int ifindex, struct timespec *stamp, void *arg);
+
+/* Socket AF_PACKET con un anillo TPACKET_V3 compartido con el kernel.
+ * El kernel llena bloques completos y los entrega al vencer el timeout o al llenarse,
+ * nosotros los recorremos sin llamadas al sistema y los regresamos */
+typedef struct {
+	int fd;
+	
+	unsigned char *map;
+	size_t map_len;
+	
+	unsigned int block_size;
+	unsigned int block_count;
+	unsigned int current;
+	
+	unsigned long packets;
+	unsigned long blocks;
+	unsigned long drops;
+} PacketRing;
+
+int packet_ring_init (PacketRing *ring, uint16_t ethertype, unsigned int size, unsigned int timeout_msec);
+void packet_ring_destroy (PacketRing *ring);
+
+int packet_ring_set_filter (PacketRing *ring, struct sock_filter *code, unsigned short len);
+int packet_ring_drain (PacketRing *ring, PacketRingCB cb, void *arg);
+unsigned long packet_ring_drops (PacketRing *ring);
+
+#endif /* __PACKET_RING_H__ */
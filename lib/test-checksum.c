@@ -0,0 +1,540 @@
+/*
+ * Prueba de las implementaciones del checksum de internet y del Fletcher
+ * de utils.c.
+ *
+ * Sin argumentos compara cada implementación que soporte este CPU contra
+ * la versión original byte a byte, con largos, alineaciones y sumas
+ * parciales al azar (semilla fija). Sale con 1 si alguna difiere, para
+ * "make check".
+ *
+ * Con -b mide el rendimiento de cada implementación, en MB/s, para tamaños
+ * de paquete desde un hello de 44 bytes hasta un LSU en trama jumbo.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Las implementaciones son estáticas, incluir el archivo para llegar a ellas */
+#include "utils.c"
+
+#define TEST_BUFFER_SIZE (16384 + 64)
+#define TEST_RANDOM_RUNS 50000
+#define TEST_MAX_LEN     9216
+
+/* Más que FLETCHER_BLOCK, para pasar por más de una reducción */
+#define TEST_FLETCHER_BUFFER_SIZE (72 * 1024 + 64)
+#define TEST_FLETCHER_MAX_LEN     (70 * 1024)
+#define TEST_FLETCHER_RUNS        20000
+
+typedef uint32_t (*CsumFunc) (uint32_t partial, const void *data, size_t n);
+
+typedef struct {
+	const char *name;
+	CsumFunc func;
+} CsumKernel;
+
+typedef void (*FletcherFunc) (const uint8_t *p, size_t len, uint32_t *c0, uint32_t *c1);
+
+typedef struct {
+	const char *name;
+	FletcherFunc func;
+} FletcherKernel;
+
+static uint32_t _test_rand_state = 0x12345678;
+
+static uint32_t _test_rand (void) {
+	/* xorshift32, para que las corridas se puedan repetir */
+	_test_rand_state ^= _test_rand_state << 13;
+	_test_rand_state ^= _test_rand_state >> 17;
+	_test_rand_state ^= _test_rand_state << 5;
+	
+	return _test_rand_state;
+}
+
+/* La suma original, 16 bits a la vez */
+static uint32_t _ref_csum_continue (uint32_t partial, const void *data_, size_t n) {
+	const uint8_t *data = data_;
+	uint16_t w;
+	
+	for (; n > 1; n -= 2, data += 2) {
+		memcpy (&w, data, sizeof (w));
+		partial = csum_add16 (partial, w);
+	}
+	if (n) {
+		partial += *data;
+	}
+	
+	return partial;
+}
+
+static int _test_csum_kernels (CsumKernel *kernels) {
+	int n = 0;
+	
+	kernels[n].name = "word";
+	kernels[n++].func = _csum_continue_word;
+#ifdef CSUM_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("sse2")) {
+		kernels[n].name = "sse2";
+		kernels[n++].func = _csum_continue_sse2;
+	}
+	if (__builtin_cpu_supports ("avx2")) {
+		kernels[n].name = "avx2";
+		kernels[n++].func = _csum_continue_avx2;
+	}
+#endif
+	kernels[n].name = "dispatch";
+	kernels[n++].func = csum_continue;
+	
+	return n;
+}
+
+static void _test_fill (uint8_t *buffer, size_t len) {
+	size_t g;
+	
+	for (g = 0; g < len; g++) {
+		buffer[g] = _test_rand ();
+	}
+	
+	/* Algunas corridas llenas de 0xff, el peor caso para los acarreos */
+	if ((_test_rand () & 15) == 0) {
+		memset (buffer, 0xff, len);
+	}
+}
+
+static int _test_csum_one (CsumKernel *kernel, const uint8_t *data, size_t len, uint32_t partial) {
+	uint16_t expected, got;
+	size_t split;
+	
+	expected = csum_finish (_ref_csum_continue (partial, data, len));
+	
+	got = csum_finish (kernel->func (partial, data, len));
+	if (got != expected) {
+		printf ("csum %s: len %zu, alineación %u, parcial 0x%x: 0x%04x, se esperaba 0x%04x\n", kernel->name, len, (unsigned int) ((uintptr_t) data & 63), partial, got, expected);
+		return 1;
+	}
+	
+	/* En dos partes, cortando en un byte par como lo hacen los segmentos */
+	split = len / 2 & ~ (size_t) 1;
+	got = csum_finish (kernel->func (kernel->func (partial, data, split), data + split, len - split));
+	if (got != expected) {
+		printf ("csum %s: len %zu cortado en %zu, parcial 0x%x: 0x%04x, se esperaba 0x%04x\n", kernel->name, len, split, partial, got, expected);
+		return 1;
+	}
+	
+	return 0;
+}
+
+static int _test_csum (void) {
+	CsumKernel kernels[8];
+	int n_kernels, g, k, errors;
+	uint8_t *buffer;
+	size_t len, offset;
+	uint32_t partial;
+	
+	buffer = aligned_alloc (64, TEST_BUFFER_SIZE);
+	if (buffer == NULL) return 1;
+	
+	n_kernels = _test_csum_kernels (kernels);
+	errors = 0;
+	
+	/* Todos los largos cortos, con todas las alineaciones, cubren las colas de cada versión */
+	for (len = 0; len <= 600 && errors == 0; len++) {
+		for (offset = 0; offset < 64 && errors == 0; offset++) {
+			_test_fill (buffer + offset, len);
+			partial = _test_rand () & 0xffff;
+			
+			for (k = 0; k < n_kernels; k++) {
+				errors += _test_csum_one (&kernels[k], buffer + offset, len, partial);
+			}
+		}
+	}
+	
+	for (g = 0; g < TEST_RANDOM_RUNS && errors == 0; g++) {
+		len = _test_rand () % (TEST_MAX_LEN + 1);
+		offset = _test_rand () % 64;
+		_test_fill (buffer + offset, len);
+		partial = _test_rand () & 0xffff;
+		
+		for (k = 0; k < n_kernels; k++) {
+			errors += _test_csum_one (&kernels[k], buffer + offset, len, partial);
+		}
+	}
+	
+	printf ("csum_continue:");
+	for (k = 0; k < n_kernels; k++) {
+		printf (" %s", kernels[k].name);
+	}
+	printf (", %s\n", errors == 0 ? "iguales a la referencia" : "DIFERENTES");
+	
+	free (buffer);
+	
+	return errors != 0;
+}
+
+/* Las sumas de Fletcher, un byte a la vez */
+static void _ref_fletcher_sums (const uint8_t *p, size_t len, uint32_t *c0_, uint32_t *c1_) {
+	uint32_t c0 = *c0_, c1 = *c1_;
+	
+	for (; len > 0; len--, p++) {
+		c0 = (c0 + *p) % 255;
+		c1 = (c1 + c0) % 255;
+	}
+	
+	*c0_ = c0;
+	*c1_ = c1;
+}
+
+/* fletcher_checksum() tal como estaba antes de las versiones vectoriales */
+#define MODX 4102
+
+static uint16_t _ref_fletcher_checksum (unsigned char *buffer, const size_t len, const uint16_t offset) {
+	uint8_t *p;
+	int x, y, c0, c1;
+	uint16_t checksum;
+	uint16_t *csum;
+	size_t partial_len, i, left = len;
+	
+	checksum = 0;
+	
+	if (offset != FLETCHER_CHECKSUM_VALIDATE) {
+		csum = (uint16_t *) (buffer + offset);
+		*(csum) = 0;
+	}
+	
+	p = buffer;
+	c0 = 0;
+	c1 = 0;
+	
+	while (left != 0) {
+		partial_len = MIN (left, MODX);
+		
+		for (i = 0; i < partial_len; i++) {
+			c0 = c0 + *(p++);
+			c1 += c0;
+		}
+		
+		c0 = c0 % 255;
+		c1 = c1 % 255;
+		
+		left -= partial_len;
+	}
+	
+	x = (int) ((len - offset - 1) * c0 - c1) % 255;
+	
+	if (x <= 0)
+		x += 255;
+	y = 510 - c0 - x;
+	if (y > 255)
+		y -= 255;
+	
+	if (offset == FLETCHER_CHECKSUM_VALIDATE) {
+		checksum = (c1 << 8) + c0;
+	} else {
+		buffer[offset] = x;
+		buffer[offset + 1] = y;
+		
+		checksum = htons ((x << 8) | (y & 0xFF));
+	}
+	
+	return checksum;
+}
+
+/* El ciclo de la versión original, para comparar el rendimiento */
+static void _ref_fletcher_sums_modx (const uint8_t *p, size_t len, uint32_t *c0_, uint32_t *c1_) {
+	uint32_t c0 = *c0_, c1 = *c1_;
+	size_t partial_len, i;
+	
+	while (len != 0) {
+		partial_len = MIN (len, MODX);
+		
+		for (i = 0; i < partial_len; i++) {
+			c0 = c0 + *(p++);
+			c1 += c0;
+		}
+		
+		c0 = c0 % 255;
+		c1 = c1 % 255;
+		
+		len -= partial_len;
+	}
+	
+	*c0_ = c0;
+	*c1_ = c1;
+}
+
+static int _test_fletcher_kernels (FletcherKernel *kernels) {
+	int n = 0;
+	
+	kernels[n].name = "word";
+	kernels[n++].func = _fletcher_sums_word;
+#ifdef CSUM_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("ssse3")) {
+		kernels[n].name = "ssse3";
+		kernels[n++].func = _fletcher_sums_ssse3;
+	}
+	if (__builtin_cpu_supports ("avx2")) {
+		kernels[n].name = "avx2";
+		kernels[n++].func = _fletcher_sums_avx2;
+	}
+#endif
+	kernels[n].name = "dispatch";
+	kernels[n++].func = _fletcher_sums;
+	
+	return n;
+}
+
+static int _test_fletcher_one (FletcherKernel *kernel, const uint8_t *data, size_t len, uint32_t c0, uint32_t c1) {
+	uint32_t r0 = c0, r1 = c1, k0 = c0, k1 = c1;
+	
+	_ref_fletcher_sums (data, len, &r0, &r1);
+	kernel->func (data, len, &k0, &k1);
+	
+	if (k0 != r0 || k1 != r1) {
+		printf ("fletcher %s: len %zu, alineación %u, inicio %u/%u: %u/%u, se esperaba %u/%u\n", kernel->name, len, (unsigned int) ((uintptr_t) data & 63), c0, c1, k0, k1, r0, r1);
+		return 1;
+	}
+	
+	return 0;
+}
+
+/* Como un LSA: la suma empieza después del campo de edad y el checksum va en el byte 16 */
+static int _test_fletcher_lsa (uint8_t *data, uint8_t *copy, size_t len) {
+	uint16_t expected, got;
+	
+	memcpy (copy, data, len);
+	
+	expected = _ref_fletcher_checksum (copy + 2, len - 2, 14);
+	got = fletcher_checksum (data + 2, len - 2, 14);
+	
+	if (got != expected || memcmp (data, copy, len) != 0) {
+		printf ("fletcher_checksum: len %zu: 0x%04x, se esperaba 0x%04x\n", len, got, expected);
+		return 1;
+	}
+	
+	if (!fletcher_checksum_valid (data + 2, len - 2)) {
+		printf ("fletcher_checksum_valid: len %zu: rechaza su propio checksum\n", len);
+		return 1;
+	}
+	
+	got = fletcher_checksum (data + 2, len - 2, FLETCHER_CHECKSUM_VALIDATE);
+	if (got != 0) {
+		printf ("fletcher_checksum: len %zu: validar devuelve 0x%04x\n", len, got);
+		return 1;
+	}
+	
+	/* Un bit cambiado tiene que notarse */
+	data[2 + _test_rand () % (len - 2)] ^= 1 << (_test_rand () % 8);
+	if (fletcher_checksum_valid (data + 2, len - 2)) {
+		printf ("fletcher_checksum_valid: len %zu: acepta un LSA dañado\n", len);
+		return 1;
+	}
+	
+	return 0;
+}
+
+static int _test_fletcher (void) {
+	FletcherKernel kernels[8];
+	int n_kernels, g, k, errors;
+	uint8_t *buffer, *copy;
+	size_t len, offset;
+	uint32_t c0, c1;
+	
+	buffer = aligned_alloc (64, TEST_FLETCHER_BUFFER_SIZE);
+	copy = malloc (TEST_FLETCHER_BUFFER_SIZE);
+	if (buffer == NULL || copy == NULL) {
+		free (buffer);
+		free (copy);
+		return 1;
+	}
+	
+	n_kernels = _test_fletcher_kernels (kernels);
+	errors = 0;
+	
+	/* Los largos cortos cubren las colas y los cambios de versión en 64 y 256 bytes */
+	for (len = 0; len <= 600 && errors == 0; len++) {
+		for (offset = 0; offset < 64 && errors == 0; offset++) {
+			_test_fill (buffer + offset, len);
+			c0 = _test_rand () % 255;
+			c1 = _test_rand () % 255;
+			
+			for (k = 0; k < n_kernels; k++) {
+				errors += _test_fletcher_one (&kernels[k], buffer + offset, len, c0, c1);
+			}
+		}
+	}
+	
+	for (g = 0; g < TEST_FLETCHER_RUNS && errors == 0; g++) {
+		/* La mayoría del tamaño de un LSA, algunos mayores que FLETCHER_BLOCK */
+		if (g % 100 == 0) {
+			len = _test_rand () % (TEST_FLETCHER_MAX_LEN + 1);
+		} else {
+			len = _test_rand () % (TEST_MAX_LEN + 1);
+		}
+		offset = _test_rand () % 64;
+		_test_fill (buffer + offset, len);
+		c0 = _test_rand () % 255;
+		c1 = _test_rand () % 255;
+		
+		for (k = 0; k < n_kernels; k++) {
+			errors += _test_fletcher_one (&kernels[k], buffer + offset, len, c0, c1);
+		}
+		
+		/* El encabezado de un LSA tiene 20 bytes */
+		if (len >= 20 && len <= 65535 && errors == 0) {
+			errors += _test_fletcher_lsa (buffer + offset, copy, len);
+		}
+	}
+	
+	printf ("fletcher:");
+	for (k = 0; k < n_kernels; k++) {
+		printf (" %s", kernels[k].name);
+	}
+	printf (", %s\n", errors == 0 ? "iguales a la referencia" : "DIFERENTES");
+	
+	free (buffer);
+	free (copy);
+	
+	return errors != 0;
+}
+
+static double _test_elapsed (struct timespec *start) {
+	struct timespec now;
+	
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Suficientes vueltas para pasar unos 256 MB por la función */
+static double _test_bench_csum (CsumFunc func, const uint8_t *data, size_t len) {
+	struct timespec start;
+	volatile uint32_t sink;
+	long iterations, g;
+	uint32_t sum;
+	double secs;
+	
+	iterations = (256L << 20) / len;
+	sum = 0;
+	
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	for (g = 0; g < iterations; g++) {
+		sum += csum_finish (func (0, data, len));
+	}
+	secs = _test_elapsed (&start);
+	
+	sink = sum;
+	(void) sink;
+	
+	return (double) iterations * len / secs / 1e6;
+}
+
+static double _test_bench_fletcher (FletcherFunc func, const uint8_t *data, size_t len) {
+	struct timespec start;
+	volatile uint32_t sink;
+	long iterations, g;
+	uint32_t c0, c1, sum;
+	double secs;
+	
+	iterations = (256L << 20) / len;
+	sum = 0;
+	
+	clock_gettime (CLOCK_MONOTONIC, &start);
+	for (g = 0; g < iterations; g++) {
+		c0 = c1 = 0;
+		func (data, len, &c0, &c1);
+		sum += c0 + c1;
+	}
+	secs = _test_elapsed (&start);
+	
+	sink = sum;
+	(void) sink;
+	
+	return (double) iterations * len / secs / 1e6;
+}
+
+static const size_t _test_bench_sizes[] = { 44, 64, 128, 256, 512, 1024, 1500, 4096, 9000 };
+
+static void _test_bench_csum_all (void) {
+	CsumKernel kernels[8];
+	int n_kernels, k;
+	size_t s, len;
+	uint8_t *buffer;
+	
+	buffer = aligned_alloc (64, TEST_BUFFER_SIZE);
+	if (buffer == NULL) return;
+	
+	_test_fill (buffer, TEST_BUFFER_SIZE);
+	n_kernels = _test_csum_kernels (kernels);
+	
+	printf ("\ncsum_continue, MB/s\n%8s %10s", "bytes", "referencia");
+	for (k = 0; k < n_kernels; k++) {
+		printf (" %10s", kernels[k].name);
+	}
+	printf ("\n");
+	
+	for (s = 0; s < sizeof (_test_bench_sizes) / sizeof (_test_bench_sizes[0]); s++) {
+		len = _test_bench_sizes[s];
+		
+		printf ("%8zu %10.0f", len, _test_bench_csum (_ref_csum_continue, buffer, len));
+		for (k = 0; k < n_kernels; k++) {
+			printf (" %10.0f", _test_bench_csum (kernels[k].func, buffer, len));
+		}
+		printf ("\n");
+	}
+	
+	free (buffer);
+}
+
+static void _test_bench_fletcher_all (void) {
+	FletcherKernel kernels[8];
+	int n_kernels, k;
+	size_t s, len;
+	uint8_t *buffer;
+	
+	buffer = aligned_alloc (64, TEST_BUFFER_SIZE);
+	if (buffer == NULL) return;
+	
+	_test_fill (buffer, TEST_BUFFER_SIZE);
+	n_kernels = _test_fletcher_kernels (kernels);
+	
+	printf ("\nfletcher, MB/s\n%8s %10s", "bytes", "referencia");
+	for (k = 0; k < n_kernels; k++) {
+		printf (" %10s", kernels[k].name);
+	}
+	printf ("\n");
+	
+	for (s = 0; s < sizeof (_test_bench_sizes) / sizeof (_test_bench_sizes[0]); s++) {
+		len = _test_bench_sizes[s];
+		
+		printf ("%8zu %10.0f", len, _test_bench_fletcher (_ref_fletcher_sums_modx, buffer, len));
+		for (k = 0; k < n_kernels; k++) {
+			printf (" %10.0f", _test_bench_fletcher (kernels[k].func, buffer, len));
+		}
+		printf ("\n");
+	}
+	
+	free (buffer);
+}
+
+int main (int argc, char *argv[]) {
+	int errors;
+	
+	if (argc > 1 && strcmp (argv[1], "-b") == 0) {
+		_test_bench_csum_all ();
+		_test_bench_fletcher_all ();
+		
+		return 0;
+	}
+	
+	errors = 0;
+	errors += _test_csum ();
+	errors += _test_fletcher ();
+	
+	return errors != 0;
+}
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timers.h"
+
+struct timespec timespec_add_msec (struct timespec t, long msec) {
+	t.tv_sec += msec / 1000;
+	t.tv_nsec += (msec % 1000) * 1000000;
+	
+	if (t.tv_nsec >= 1000000000) {
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000;
+	} else if (t.tv_nsec < 0) {
+		t.tv_sec--;
+		t.tv_nsec += 1000000000;
+	}
+	
+	return t;
+}
+
+int timespec_cmp (struct timespec a, struct timespec b) {
+	if (a.tv_sec < b.tv_sec) return -1;
+	if (a.tv_sec > b.tv_sec) return 1;
+	if (a.tv_nsec < b.tv_nsec) return -1;
+	if (a.tv_nsec > b.tv_nsec) return 1;
+	
+	return 0;
+}
+
+static void _timers_swap (TimerQueue *queue, int a, int b) {
+	Timer *t;
+	
+	t = queue->heap[a];
+	queue->heap[a] = queue->heap[b];
+	queue->heap[b] = t;
+	
+	queue->heap[a]->heap_pos = a;
+	queue->heap[b]->heap_pos = b;
+}
+
+static void _timers_sift_up (TimerQueue *queue, int pos) {
+	int parent;
+	
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		
+		if (timespec_cmp (queue->heap[pos]->deadline, queue->heap[parent]->deadline) >= 0) break;
+		
+		_timers_swap (queue, pos, parent);
+		pos = parent;
+	}
+}
+
+static void _timers_sift_down (TimerQueue *queue, int pos) {
+	int left, right, min;
+	
+	while (1) {
+		left = pos * 2 + 1;
+		right = left + 1;
+		min = pos;
+		
+		if (left < queue->count && timespec_cmp (queue->heap[left]->deadline, queue->heap[min]->deadline) < 0) {
+			min = left;
+		}
+		
+		if (right < queue->count && timespec_cmp (queue->heap[right]->deadline, queue->heap[min]->deadline) < 0) {
+			min = right;
+		}
+		
+		if (min == pos) break;
+		
+		_timers_swap (queue, pos, min);
+		pos = min;
+	}
+}
+
+void timers_queue_init (TimerQueue *queue) {
+	queue->heap = NULL;
+	queue->count = 0;
+	queue->size = 0;
+}
+
+void timers_queue_destroy (TimerQueue *queue) {
+	int g;
+	
+	for (g = 0; g < queue->count; g++) {
+		queue->heap[g]->heap_pos = -1;
+	}
+	
+	free (queue->heap);
+	timers_queue_init (queue);
+}
+
+void timers_init (Timer *timer, TimerCB cb, void *arg) {
+	memset (&timer->deadline, 0, sizeof (timer->deadline));
+	timer->cb = cb;
+	timer->arg = arg;
+	timer->heap_pos = -1;
+}
+
+int timers_is_pending (Timer *timer) {
+	return timer->heap_pos >= 0;
+}
+
+void timers_add_deadline (TimerQueue *queue, Timer *timer, struct timespec deadline) {
+	Timer **new_heap;
+	int new_size;
+	int old;
+	
+	if (timer->heap_pos >= 0) {
+		/* Ya estaba programado, solo reacomodar */
+		old = timespec_cmp (deadline, timer->deadline);
+		timer->deadline = deadline;
+		
+		if (old < 0) {
+			_timers_sift_up (queue, timer->heap_pos);
+		} else if (old > 0) {
+			_timers_sift_down (queue, timer->heap_pos);
+		}
+		return;
+	}
+	
+	if (queue->count == queue->size) {
+		new_size = (queue->size == 0) ? 16 : queue->size * 2;
+		new_heap = (Timer **) realloc (queue->heap, new_size * sizeof (Timer *));
+		
+		if (new_heap == NULL) {
+			/* Quien llama da por hecho que el timer quedó programado: un hello o un
+			 * timer de inactividad perdido deja al enlace o al vecino atorado para siempre */
+			perror ("No se pudo crecer la cola de timers");
+			abort ();
+		}
+		
+		queue->heap = new_heap;
+		queue->size = new_size;
+	}
+	
+	timer->deadline = deadline;
+	timer->heap_pos = queue->count;
+	queue->heap[queue->count] = timer;
+	queue->count++;
+	
+	_timers_sift_up (queue, timer->heap_pos);
+}
+
+void timers_add_msec (TimerQueue *queue, Timer *timer, long msec) {
+	struct timespec now;
+	
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	
+	timers_add_deadline (queue, timer, timespec_add_msec (now, msec));
+}
+
+void timers_cancel (TimerQueue *queue, Timer *timer) {
+	int pos;
+	
+	if (timer->heap_pos < 0) return;
+	
+	pos = timer->heap_pos;
+	queue->count--;
+	
+	if (pos != queue->count) {
+		/* Mover el último elemento a este hueco */
+		queue->heap[pos] = queue->heap[queue->count];
+		queue->heap[pos]->heap_pos = pos;
+		
+		_timers_sift_down (queue, pos);
+		_timers_sift_up (queue, queue->heap[pos]->heap_pos);
+	}
+	
+	timer->heap_pos = -1;
+}
+
+/* Resta a "msec" un valor aleatorio de hasta "percent" por ciento.
+ * Solo se adelanta, así un hello con jitter nunca llega después de su intervalo */
+long timers_jitter (long msec, int percent) {
+	long range;
+	
+	if (percent <= 0 || msec <= 0) return msec;
+	
+	range = (msec * percent) / 100;
+	
+	if (range <= 0) return msec;
+	
+	return msec - (random () % (range + 1));
+}
+
+void throttle_init (Throttle *throttle, long initial_msec, long hold_msec, long max_msec) {
+	throttle->initial_msec = initial_msec;
+	throttle->hold_msec = hold_msec;
+	throttle->max_msec = max_msec;
+	
+	throttle->current_hold = hold_msec;
+	throttle->has_last = 0;
+}
+
+/* Calcula cuánto esperar para un nuevo evento y avanza el backoff */
+long throttle_next_delay (Throttle *throttle) {
+	struct timespec now;
+	long since, delay;
+	
+	if (throttle->has_last == 0) {
+		return throttle->initial_msec;
+	}
+	
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	since = (now.tv_sec - throttle->last.tv_sec) * 1000 + (now.tv_nsec - throttle->last.tv_nsec) / 1000000;
+	
+	if (since >= throttle->max_msec) {
+		/* Periodo tranquilo, reiniciar el backoff */
+		throttle->current_hold = throttle->hold_msec;
+		
+		return throttle->initial_msec;
+	}
+	
+	delay = throttle->current_hold - since;
+	if (delay < throttle->initial_msec) delay = throttle->initial_msec;
+	
+	throttle->current_hold = throttle->current_hold * 2;
+	if (throttle->current_hold > throttle->max_msec) throttle->current_hold = throttle->max_msec;
+	
+	return delay;
+}
+
+/* Marcar el momento en el que el evento ocurrió */
+void throttle_fired (Throttle *throttle) {
+	clock_gettime (CLOCK_MONOTONIC, &throttle->last);
+	throttle->has_last = 1;
+}
+
+/* Copia el deadline del siguiente timer en "deadline".
+ * Devuelve 0 si no hay timers programados */
+int timers_next_deadline (TimerQueue *queue, struct timespec *deadline) {
+	if (queue->count == 0) return 0;
+	
+	*deadline = queue->heap[0]->deadline;
+	
+	return 1;
+}
+
+/* Devuelve los milisegundos que faltan para el siguiente timer,
+ * redondeando hacia arriba, o -1 si no hay timers programados.
+ * Útil directamente como timeout de poll () */
+int timers_next_timeout (TimerQueue *queue) {
+	struct timespec now;
+	Timer *first;
+	long msec;
+	
+	if (queue->count == 0) return -1;
+	
+	first = queue->heap[0];
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	
+	if (timespec_cmp (first->deadline, now) <= 0) return 0;
+	
+	msec = (first->deadline.tv_sec - now.tv_sec) * 1000;
+	msec += (first->deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+	
+	if (msec <= 0) return 0;
+	
+	return msec;
+}
+
+/* Dispara todos los timers vencidos.
+ * Cada timer se saca del heap antes de llamar a su callback,
+ * así el callback puede volver a programarlo o liberar la estructura que lo contiene */
+void timers_run (TimerQueue *queue) {
+	struct timespec now;
+	Timer *first;
+	
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	
+	while (queue->count > 0) {
+		first = queue->heap[0];
+		
+		if (timespec_cmp (first->deadline, now) > 0) break;
+		
+		timers_cancel (queue, first);
+		
+		first->cb (first->arg);
+	}
+}
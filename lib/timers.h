@@ -0,0 +1,61 @@
+#ifndef __TIMERS_H__
+#define __TIMERS_H__
+
+#include <time.h>
+
+typedef void (*TimerCB) (void *);
+
+typedef struct _Timer {
+	/* Momento (CLOCK_MONOTONIC) en el que debe dispararse */
+	struct timespec deadline;
+	
+	TimerCB cb;
+	void *arg;
+	
+	/* Posición dentro del heap, -1 si no está programado */
+	int heap_pos;
+} Timer;
+
+/* Throttle con backoff exponencial: el primer evento sale tras "initial",
+ * los siguientes esperan "hold", que se duplica hasta "max" mientras sigan llegando
+ * y vuelve a "hold" después de "max" sin eventos */
+typedef struct {
+	long initial_msec;
+	long hold_msec;
+	long max_msec;
+	
+	long current_hold;
+	struct timespec last;
+	int has_last;
+} Throttle;
+
+typedef struct {
+	/* Min-heap ordenado por deadline */
+	Timer **heap;
+	int count;
+	int size;
+} TimerQueue;
+
+void timers_queue_init (TimerQueue *queue);
+void timers_queue_destroy (TimerQueue *queue);
+
+void timers_init (Timer *timer, TimerCB cb, void *arg);
+int timers_is_pending (Timer *timer);
+void timers_add_deadline (TimerQueue *queue, Timer *timer, struct timespec deadline);
+void timers_add_msec (TimerQueue *queue, Timer *timer, long msec);
+void timers_cancel (TimerQueue *queue, Timer *timer);
+
+int timers_next_deadline (TimerQueue *queue, struct timespec *deadline);
+int timers_next_timeout (TimerQueue *queue);
+void timers_run (TimerQueue *queue);
+
+long timers_jitter (long msec, int percent);
+
+void throttle_init (Throttle *throttle, long initial_msec, long hold_msec, long max_msec);
+long throttle_next_delay (Throttle *throttle);
+void throttle_fired (Throttle *throttle);
+
+struct timespec timespec_add_msec (struct timespec t, long msec);
+int timespec_cmp (struct timespec a, struct timespec b);
+
+#endif /* __TIMERS_H__ */
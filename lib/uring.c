@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+/* Sin liburing, las tres llamadas del sistema se hacen directamente */
+static int _uring_setup (unsigned int entries, struct io_uring_params *p) {
+	return (int) syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int _uring_enter (int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+	return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int _uring_register (int fd, unsigned int opcode, void *arg, unsigned int nr_args) {
+	return (int) syscall (__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init (URing *ring, unsigned int entries) {
+	struct io_uring_params p;
+	unsigned char *sq, *cq;
+	unsigned int g;
+	
+	memset (ring, 0, sizeof (URing));
+	memset (&p, 0, sizeof (p));
+	
+	ring->fd = _uring_setup (entries, &p);
+	
+	if (ring->fd < 0) {
+		perror ("io_uring_setup");
+		
+		return -1;
+	}
+	
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+	ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		/* Ambas colas viven en el mismo mapeo */
+		if (ring->cq_len > ring->sq_len) ring->sq_len = ring->cq_len;
+		ring->cq_len = ring->sq_len;
+	}
+	
+	ring->sq_ptr = mmap (NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	
+	if (ring->sq_ptr == MAP_FAILED) {
+		perror ("mmap SQ");
+		close (ring->fd);
+		ring->fd = -1;
+		
+		return -1;
+	}
+	
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ptr = ring->sq_ptr;
+	} else {
+		ring->cq_ptr = mmap (NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		
+		if (ring->cq_ptr == MAP_FAILED) {
+			perror ("mmap CQ");
+			munmap (ring->sq_ptr, ring->sq_len);
+			close (ring->fd);
+			ring->fd = -1;
+			
+			return -1;
+		}
+	}
+	
+	ring->sqes_len = p.sq_entries * sizeof (struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *) mmap (NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	
+	if (ring->sqes == MAP_FAILED) {
+		perror ("mmap SQES");
+		if (ring->cq_ptr != ring->sq_ptr) munmap (ring->cq_ptr, ring->cq_len);
+		munmap (ring->sq_ptr, ring->sq_len);
+		close (ring->fd);
+		ring->fd = -1;
+		
+		return -1;
+	}
+	
+	sq = (unsigned char *) ring->sq_ptr;
+	ring->sq_head = (unsigned int *) (sq + p.sq_off.head);
+	ring->sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+	ring->sq_mask = *(unsigned int *) (sq + p.sq_off.ring_mask);
+	ring->sq_entries = p.sq_entries;
+	ring->sq_array = (unsigned int *) (sq + p.sq_off.array);
+	ring->sq_local_tail = *ring->sq_tail;
+	
+	cq = (unsigned char *) ring->cq_ptr;
+	ring->cq_head = (unsigned int *) (cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+	ring->cq_mask = *(unsigned int *) (cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+	
+	/* Cada posición de la SQ apunta siempre a su mismo SQE */
+	for (g = 0; g < ring->sq_entries; g++) {
+		ring->sq_array[g] = g;
+	}
+	
+	return 0;
+}
+
+void uring_destroy (URing *ring) {
+	if (ring->fd < 0) return;
+	
+	munmap (ring->sqes, ring->sqes_len);
+	if (ring->cq_ptr != ring->sq_ptr) munmap (ring->cq_ptr, ring->cq_len);
+	munmap (ring->sq_ptr, ring->sq_len);
+	
+	close (ring->fd);
+	ring->fd = -1;
+}
+
+/* Devuelve un SQE limpio, o NULL si la cola está llena aún después de enviarla */
+struct io_uring_sqe *uring_get_sqe (URing *ring) {
+	struct io_uring_sqe *sqe;
+	unsigned int head;
+	
+	head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+	
+	if (ring->sq_local_tail - head >= ring->sq_entries) {
+		/* Cola llena, entregar lo pendiente al kernel */
+		if (uring_submit (ring, 0) < 0) return NULL;
+		
+		head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+		if (ring->sq_local_tail - head >= ring->sq_entries) return NULL;
+	}
+	
+	sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+	memset (sqe, 0, sizeof (struct io_uring_sqe));
+	
+	ring->sq_local_tail++;
+	
+	return sqe;
+}
+
+/* Entrega al kernel todos los SQE preparados con una sola llamada,
+ * y opcionalmente espera "wait_nr" terminaciones */
+int uring_submit (URing *ring, unsigned int wait_nr) {
+	unsigned int to_submit;
+	int res;
+	
+	to_submit = ring->sq_local_tail - *ring->sq_tail;
+	
+	if (to_submit == 0 && wait_nr == 0) return 0;
+	
+	__atomic_store_n (ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	
+	do {
+		res = _uring_enter (ring->fd, to_submit, wait_nr, (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0);
+	} while (res < 0 && errno == EINTR);
+	
+	ring->enters++;
+	
+	if (res < 0) {
+		perror ("io_uring_enter");
+	}
+	
+	return res;
+}
+
+/* Consume todas las terminaciones disponibles.
+ * El CQE se libera antes del callback, así el callback puede preparar nuevas peticiones */
+int uring_reap (URing *ring, URingCompletionCB cb, void *arg) {
+	struct io_uring_cqe *cqe;
+	unsigned int head, tail;
+	uint64_t user_data;
+	unsigned int flags;
+	int res, count;
+	
+	count = 0;
+	head = *ring->cq_head;
+	
+	while (1) {
+		tail = __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE);
+		
+		if (head == tail) break;
+		
+		cqe = &ring->cqes[head & ring->cq_mask];
+		user_data = cqe->user_data;
+		res = cqe->res;
+		flags = cqe->flags;
+		
+		head++;
+		__atomic_store_n (ring->cq_head, head, __ATOMIC_RELEASE);
+		
+		cb (user_data, res, flags, arg);
+		count++;
+	}
+	
+	return count;
+}
+
+int uring_buffers_init (URing *ring, URingBufferGroup *group, unsigned short bgid, unsigned int count, unsigned int size) {
+	struct io_uring_buf_reg reg;
+	unsigned int g;
+	
+	memset (group, 0, sizeof (URingBufferGroup));
+	
+	/* El kernel exige una potencia de 2 */
+	if (count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+		return -1;
+	}
+	
+	group->count = count;
+	group->size = size;
+	group->bgid = bgid;
+	
+	/* El anillo debe estar alineado a página, mmap lo garantiza */
+	group->ring_len = count * sizeof (struct io_uring_buf);
+	group->ring = (struct io_uring_buf_ring *) mmap (NULL, group->ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	
+	if (group->ring == MAP_FAILED) {
+		perror ("mmap buf ring");
+		group->ring = NULL;
+		
+		return -1;
+	}
+	
+	group->data = (unsigned char *) malloc ((size_t) count * size);
+	
+	if (group->data == NULL) {
+		munmap (group->ring, group->ring_len);
+		group->ring = NULL;
+		
+		return -1;
+	}
+	
+	memset (&reg, 0, sizeof (reg));
+	reg.ring_addr = (unsigned long) group->ring;
+	reg.ring_entries = count;
+	reg.bgid = bgid;
+	
+	if (_uring_register (ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		perror ("io_uring_register PBUF_RING");
+		
+		free (group->data);
+		munmap (group->ring, group->ring_len);
+		group->data = NULL;
+		group->ring = NULL;
+		
+		return -1;
+	}
+	
+	for (g = 0; g < count; g++) {
+		uring_buffer_recycle (group, g);
+	}
+	
+	return 0;
+}
+
+void uring_buffers_destroy (URing *ring, URingBufferGroup *group) {
+	struct io_uring_buf_reg reg;
+	
+	if (group->ring == NULL) return;
+	
+	memset (&reg, 0, sizeof (reg));
+	reg.bgid = group->bgid;
+	
+	_uring_register (ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+	
+	munmap (group->ring, group->ring_len);
+	free (group->data);
+	
+	group->ring = NULL;
+	group->data = NULL;
+}
+
+unsigned char *uring_buffer_get (URingBufferGroup *group, unsigned int bid) {
+	return group->data + (size_t) bid * group->size;
+}
+
+/* Devuelve un buffer al anillo para que el kernel lo vuelva a usar */
+void uring_buffer_recycle (URingBufferGroup *group, unsigned int bid) {
+	struct io_uring_buf *buf;
+	
+	buf = &group->ring->bufs[group->tail & (group->count - 1)];
+	buf->addr = (unsigned long) uring_buffer_get (group, bid);
+	buf->len = group->size;
+	buf->bid = bid;
+	
+	group->tail++;
+	__atomic_store_n (&group->ring->tail, group->tail, __ATOMIC_RELEASE);
+}
+
+/* Un solo recvmsg que sigue entregando paquetes hasta que se cancele o se acaben los buffers.
+ * Del msghdr solo se usan msg_namelen y msg_controllen */
+int uring_recvmsg_multishot (URing *ring, int fd, struct msghdr *msg, URingBufferGroup *group, uint64_t user_data) {
+	struct io_uring_sqe *sqe;
+	
+	sqe = uring_get_sqe (ring);
+	
+	if (sqe == NULL) return -1;
+	
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long) msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = group->bgid;
+	sqe->user_data = user_data;
+	
+	return 0;
+}
+
+int uring_recv_multishot (URing *ring, int fd, URingBufferGroup *group, uint64_t user_data) {
+	struct io_uring_sqe *sqe;
+	
+	sqe = uring_get_sqe (ring);
+	
+	if (sqe == NULL) return -1;
+	
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = group->bgid;
+	sqe->user_data = user_data;
+	
+	return 0;
+}
+
+/* El msghdr y todo lo que apunta debe seguir vivo hasta su terminación */
+int uring_sendmsg (URing *ring, int fd, struct msghdr *msg, uint64_t user_data) {
+	struct io_uring_sqe *sqe;
+	
+	sqe = uring_get_sqe (ring);
+	
+	if (sqe == NULL) return -1;
+	
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long) msg;
+	sqe->len = 1;
+	sqe->user_data = user_data;
+	
+	return 0;
+}
+
+/* Un recvmsg multishot deja en el buffer: io_uring_recvmsg_out, el nombre, el control y los datos.
+ * Rellena "msg" apuntando dentro del buffer, para recorrerlo con CMSG_FIRSTHDR */
+int uring_recvmsg_parse (unsigned char *buf, int res, struct msghdr *tmpl, struct msghdr *msg, unsigned char **payload, unsigned int *payload_len) {
+	struct io_uring_recvmsg_out *out;
+	unsigned int offset;
+	
+	offset = sizeof (struct io_uring_recvmsg_out) + tmpl->msg_namelen + tmpl->msg_controllen;
+	
+	if (res < 0 || (unsigned int) res < offset) return -1;
+	
+	out = (struct io_uring_recvmsg_out *) buf;
+	
+	memset (msg, 0, sizeof (struct msghdr));
+	msg->msg_name = buf + sizeof (struct io_uring_recvmsg_out);
+	msg->msg_namelen = (out->namelen < tmpl->msg_namelen) ? out->namelen : tmpl->msg_namelen;
+	msg->msg_control = buf + sizeof (struct io_uring_recvmsg_out) + tmpl->msg_namelen;
+	msg->msg_controllen = (out->controllen < tmpl->msg_controllen) ? out->controllen : tmpl->msg_controllen;
+	msg->msg_flags = out->flags;
+	
+	*payload = buf + offset;
+	*payload_len = res - offset;
+	
+	/* Si el paquete no cabía, payloadlen es el tamaño original */
+	if (out->payloadlen < *payload_len) *payload_len = out->payloadlen;
+	
+	return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stdint.h>
+
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+/* El user_data de cada petición lleva el tipo en la parte alta y un índice en la baja */
+#define URING_TAG(kind, index) (((uint64_t) (kind) << 32) | (uint32_t) (index))
+#define URING_TAG_KIND(tag) ((unsigned int) ((tag) >> 32))
+#define URING_TAG_INDEX(tag) ((unsigned int) ((tag) & 0xFFFFFFFF))
+
+#define URING_KIND_OSPF_RECV    1
+#define URING_KIND_OSPF_SEND    2
+#define URING_KIND_NETLINK_RECV 3
+
+typedef void (*URingCompletionCB) (uint64_t user_data, int res, unsigned int flags, void *arg);
+
+/* Anillo de buffers registrado en el kernel, de donde los recv multishot toman su buffer */
+typedef struct {
+	struct io_uring_buf_ring *ring;
+	size_t ring_len;
+	
+	unsigned char *data;
+	unsigned int count;
+	unsigned int size;
+	
+	unsigned short bgid;
+	unsigned short tail;
+} URingBufferGroup;
+
+typedef struct {
+	int fd;
+	
+	/* Cola de envío (SQ) */
+	void *sq_ptr;
+	size_t sq_len;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_array;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	
+	/* Cola de terminación (CQ) */
+	void *cq_ptr;
+	size_t cq_len;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	
+	/* Llamadas a io_uring_enter, para comparar contra las de recvmsg/sendmsg */
+	unsigned long enters;
+} URing;
+
+int uring_init (URing *ring, unsigned int entries);
+void uring_destroy (URing *ring);
+
+struct io_uring_sqe *uring_get_sqe (URing *ring);
+int uring_submit (URing *ring, unsigned int wait_nr);
+int uring_reap (URing *ring, URingCompletionCB cb, void *arg);
+
+int uring_buffers_init (URing *ring, URingBufferGroup *group, unsigned short bgid, unsigned int count, unsigned int size);
+void uring_buffers_destroy (URing *ring, URingBufferGroup *group);
+unsigned char *uring_buffer_get (URingBufferGroup *group, unsigned int bid);
+void uring_buffer_recycle (URingBufferGroup *group, unsigned int bid);
+
+int uring_recvmsg_multishot (URing *ring, int fd, struct msghdr *msg, URingBufferGroup *group, uint64_t user_data);
+int uring_recv_multishot (URing *ring, int fd, URingBufferGroup *group, uint64_t user_data);
+int uring_sendmsg (URing *ring, int fd, struct msghdr *msg, uint64_t user_data);
+
+int uring_recvmsg_parse (unsigned char *buf, int res, struct msghdr *tmpl, struct msghdr *msg, unsigned char **payload, unsigned int *payload_len);
+
+#endif /* __URING_H__ */
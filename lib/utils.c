@@ -6,6 +6,11 @@
 
 #include "utils.h"
 
+#if defined (__x86_64__) || defined (__i386__)
+#include <immintrin.h>
+#define CSUM_X86 1
+#endif
+
 #ifndef MAX
 #define MAX(a, b) \
 	({ typeof (a) _a = (a); \
@@ -92,20 +97,146 @@ uint32_t csum_add32 (uint32_t partial, uint32_t new) {
 }
 
 
-/* Adds the 'n' bytes in 'data' to the partial IP checksum 'partial' and
- * returns the updated checksum.  (To start a new checksum, pass 0 for
- * 'partial'.  To obtain the finished checksum, pass the return value to
- * csum_finish().) */
-uint32_t csum_continue (uint32_t partial, const void *data_, size_t n) {
-	const uint16_t *data = data_;
+/* Folds a 64-bit one's complement accumulator down to 16 bits.  Since
+ * 2^16 and 2^32 are both 1 modulo 0xffff, the result is congruent to the
+ * sum of the 16-bit words, and it is zero only if the sum was zero, so
+ * csum_finish() gives the same answer as adding 16 bits at a time. */
+static uint32_t _csum_fold64 (uint64_t sum) {
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
 	
-	for (; n > 1; n -= 2, data++) {
-		partial = csum_add16 (partial, *((uint16_t *)data));
+	return sum;
+}
+
+/* Portable version: each 64-bit word is added as two 32-bit halves into a
+ * 64-bit accumulator, so no carry is ever lost.  Also used for the tail
+ * of the vector versions. */
+static uint32_t _csum_continue_64 (uint64_t sum, const uint8_t *data, size_t n) {
+	uint64_t w;
+	uint16_t h;
+	
+	for (; n >= 8; n -= 8, data += 8) {
+		memcpy (&w, data, sizeof (w));
+		sum += (w & 0xffffffff) + (w >> 32);
+	}
+	if (n >= 4) {
+		uint32_t v;
+		
+		memcpy (&v, data, sizeof (v));
+		sum += v;
+		data += 4;
+		n -= 4;
+	}
+	if (n >= 2) {
+		memcpy (&h, data, sizeof (h));
+		sum += h;
+		data += 2;
+		n -= 2;
 	}
 	if (n) {
-		partial += *(uint8_t *) data;
+		sum += *data;
 	}
-	return partial;
+	
+	return _csum_fold64 (sum);
+}
+
+static uint32_t _csum_continue_word (uint32_t partial, const void *data, size_t n) {
+	return _csum_continue_64 (partial, data, n);
+}
+
+#ifdef CSUM_X86
+/* SSE2: four 32-bit words per load, widened to 64-bit lanes */
+__attribute__ ((target ("sse2")))
+static uint32_t _csum_continue_sse2 (uint32_t partial, const void *data_, size_t n) {
+	const uint8_t *data = data_;
+	__m128i zero = _mm_setzero_si128 ();
+	__m128i acc0 = zero, acc1 = zero;
+	__m128i v0, v1;
+	uint64_t lanes[2];
+	
+	/* Too short to pay for folding the lanes */
+	if (n < 64) return _csum_continue_64 (partial, data, n);
+	
+	for (; n >= 32; n -= 32, data += 32) {
+		v0 = _mm_loadu_si128 ((const __m128i *) data);
+		v1 = _mm_loadu_si128 ((const __m128i *) (data + 16));
+		
+		acc0 = _mm_add_epi64 (acc0, _mm_unpacklo_epi32 (v0, zero));
+		acc1 = _mm_add_epi64 (acc1, _mm_unpackhi_epi32 (v0, zero));
+		acc0 = _mm_add_epi64 (acc0, _mm_unpacklo_epi32 (v1, zero));
+		acc1 = _mm_add_epi64 (acc1, _mm_unpackhi_epi32 (v1, zero));
+	}
+	
+	_mm_storeu_si128 ((__m128i *) lanes, _mm_add_epi64 (acc0, acc1));
+	
+	return _csum_continue_64 ((uint64_t) partial + _csum_fold64 (lanes[0]) + _csum_fold64 (lanes[1]), data, n);
+}
+
+/* AVX2: the same, eight 32-bit words per load */
+__attribute__ ((target ("avx2")))
+static uint32_t _csum_continue_avx2 (uint32_t partial, const void *data_, size_t n) {
+	const uint8_t *data = data_;
+	__m256i zero = _mm256_setzero_si256 ();
+	__m256i acc0 = zero, acc1 = zero;
+	__m256i v0, v1;
+	uint64_t lanes[4];
+	uint64_t sum;
+	int g;
+	
+	if (n < 128) return _csum_continue_sse2 (partial, data, n);
+	
+	for (; n >= 64; n -= 64, data += 64) {
+		v0 = _mm256_loadu_si256 ((const __m256i *) data);
+		v1 = _mm256_loadu_si256 ((const __m256i *) (data + 32));
+		
+		acc0 = _mm256_add_epi64 (acc0, _mm256_unpacklo_epi32 (v0, zero));
+		acc1 = _mm256_add_epi64 (acc1, _mm256_unpackhi_epi32 (v0, zero));
+		acc0 = _mm256_add_epi64 (acc0, _mm256_unpacklo_epi32 (v1, zero));
+		acc1 = _mm256_add_epi64 (acc1, _mm256_unpackhi_epi32 (v1, zero));
+	}
+	
+	_mm256_storeu_si256 ((__m256i *) lanes, _mm256_add_epi64 (acc0, acc1));
+	
+	sum = partial;
+	for (g = 0; g < 4; g++) {
+		sum += _csum_fold64 (lanes[g]);
+	}
+	
+	return _csum_continue_64 (sum, data, n);
+}
+#endif
+
+static uint32_t _csum_continue_resolve (uint32_t partial, const void *data, size_t n);
+
+/* Chosen on the first call, by the features of the CPU we are running on */
+static uint32_t (*_csum_continue_impl) (uint32_t partial, const void *data, size_t n) = _csum_continue_resolve;
+
+static uint32_t _csum_continue_resolve (uint32_t partial, const void *data, size_t n) {
+	_csum_continue_impl = _csum_continue_word;
+#ifdef CSUM_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2")) {
+		_csum_continue_impl = _csum_continue_avx2;
+	} else if (__builtin_cpu_supports ("sse2")) {
+		_csum_continue_impl = _csum_continue_sse2;
+	}
+#endif
+	
+	return _csum_continue_impl (partial, data, n);
+}
+
+/* Adds the 'n' bytes in 'data' to the partial IP checksum 'partial' and
+ * returns the updated checksum.  (To start a new checksum, pass 0 for
+ * 'partial'.  To obtain the finished checksum, pass the return value to
+ * csum_finish().)
+ *
+ * The returned partial sum is already folded, so it may differ from a plain
+ * 16-bit sum, but csum_finish() of it is always the same. */
+uint32_t csum_continue (uint32_t partial, const void *data_, size_t n) {
+	return _csum_continue_impl (partial, data_, n);
 }
 
 /* Returns the IP checksum corresponding to 'partial', which is a value updated
@@ -122,19 +253,213 @@ uint16_t csum_finish (uint32_t partial) {
 	return ~partial;
 }
 
+/* Updates the finished checksum 'check' after the 'n' bytes at 'old_' are
+ * replaced by the ones at 'new_', without summing the rest of the data again
+ * (RFC 1624, eqn. 3: HC' = ~(~HC + ~m + m')).  The bytes must start at an even
+ * offset of the checksummed data and 'n' must be even. */
+uint16_t csum_replace (uint16_t check, const void *old_, const void *new_, size_t n) {
+	const uint8_t *old = old_, *new = new_;
+	uint32_t sum;
+	uint16_t m, m_new;
+	size_t g;
+	
+	sum = (uint16_t) ~check;
+	for (g = 0; g + 1 < n; g += 2) {
+		memcpy (&m, &old[g], sizeof (m));
+		memcpy (&m_new, &new[g], sizeof (m_new));
+		
+		sum += (uint16_t) ~m;
+		sum += m_new;
+	}
+	
+	return csum_finish (sum);
+}
+
 /* Fletcher Checksum -- Refer to RFC1008. */
-#define MODX                 4102   /* 5802 should be fine */
+
+/* The sums are kept in 64 bits and only reduced modulo 255 every
+ * FLETCHER_BLOCK bytes, instead of every 4102 like a 32-bit int needs.
+ * The vector versions reduce every FLETCHER_VECTOR_CHUNKS loads, before
+ * their 32-bit lanes can overflow. */
+#define FLETCHER_BLOCK         65536
+#define FLETCHER_VECTOR_CHUNKS 1024
+
+/* Adds 'len' bytes to the running sums: c1 gets n * c0 plus each byte
+ * weighted by its distance to the end, c0 gets the plain sum of the bytes.
+ * Both come back reduced modulo 255. */
+static void _fletcher_sums_word (const uint8_t *p, size_t len, uint32_t *c0_, uint32_t *c1_) {
+	uint64_t c0 = *c0_, c1 = *c1_;
+	size_t block;
+	
+	while (len != 0) {
+		block = MIN (len, (size_t) FLETCHER_BLOCK);
+		len -= block;
+		
+		/* Four bytes at a time: shorter dependency chain than c0 += b; c1 += c0 */
+		for (; block >= 4; block -= 4, p += 4) {
+			c1 += 4 * c0 + 4 * p[0] + 3 * p[1] + 2 * p[2] + p[3];
+			c0 += p[0] + p[1] + p[2] + p[3];
+		}
+		for (; block > 0; block--, p++) {
+			c0 += *p;
+			c1 += c0;
+		}
+		
+		c0 = c0 % 255;
+		c1 = c1 % 255;
+	}
+	
+	*c0_ = c0;
+	*c1_ = c1;
+}
+
+#ifdef CSUM_X86
+/* SSSE3: psadbw sums the bytes of each 16-byte load, pmaddubsw weights
+ * them 16..1.  "prev" collects the byte sums of the previous loads, each
+ * of which is worth 16 more in c1 for every load that follows. */
+__attribute__ ((target ("ssse3")))
+static void _fletcher_sums_ssse3 (const uint8_t *p, size_t len, uint32_t *c0_, uint32_t *c1_) {
+	const __m128i zero = _mm_setzero_si128 ();
+	const __m128i ones = _mm_set1_epi16 (1);
+	const __m128i weights = _mm_setr_epi8 (16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	__m128i v, vs1, vs2, prev;
+	uint32_t l1[4], l2[4], lp[4];
+	uint64_t c0 = *c0_, c1 = *c1_, s1, s2;
+	size_t chunks, n;
+	int g;
+	
+	/* Too short to pay for the horizontal sums */
+	if (len < 64) {
+		_fletcher_sums_word (p, len, c0_, c1_);
+		return;
+	}
+	
+	while (len >= 16) {
+		chunks = MIN (len / 16, (size_t) FLETCHER_VECTOR_CHUNKS);
+		n = chunks * 16;
+		len -= n;
+		
+		vs1 = vs2 = prev = zero;
+		for (; chunks > 0; chunks--, p += 16) {
+			v = _mm_loadu_si128 ((const __m128i *) p);
+			
+			prev = _mm_add_epi32 (prev, vs1);
+			vs1 = _mm_add_epi32 (vs1, _mm_sad_epu8 (v, zero));
+			vs2 = _mm_add_epi32 (vs2, _mm_madd_epi16 (_mm_maddubs_epi16 (v, weights), ones));
+		}
+		
+		_mm_storeu_si128 ((__m128i *) l1, vs1);
+		_mm_storeu_si128 ((__m128i *) l2, vs2);
+		_mm_storeu_si128 ((__m128i *) lp, prev);
+		
+		s1 = s2 = 0;
+		for (g = 0; g < 4; g++) {
+			s1 += l1[g];
+			s2 += l2[g] + 16 * (uint64_t) lp[g];
+		}
+		
+		c1 = (c1 + n * c0 + s2) % 255;
+		c0 = (c0 + s1) % 255;
+	}
+	
+	*c0_ = c0;
+	*c1_ = c1;
+	
+	_fletcher_sums_word (p, len, c0_, c1_);
+}
+
+/* AVX2: the same with 32-byte loads, weights 32..1 */
+__attribute__ ((target ("avx2")))
+static void _fletcher_sums_avx2 (const uint8_t *p, size_t len, uint32_t *c0_, uint32_t *c1_) {
+	const __m256i zero = _mm256_setzero_si256 ();
+	const __m256i ones = _mm256_set1_epi16 (1);
+	const __m256i weights = _mm256_setr_epi8 (32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+	                                          16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	__m256i v, vs1, vs2, prev;
+	uint32_t l1[8], l2[8], lp[8];
+	uint64_t c0 = *c0_, c1 = *c1_, s1, s2;
+	size_t chunks, n;
+	int g;
+	
+	if (len < 256) {
+		_fletcher_sums_ssse3 (p, len, c0_, c1_);
+		return;
+	}
+	
+	while (len >= 32) {
+		chunks = MIN (len / 32, (size_t) FLETCHER_VECTOR_CHUNKS);
+		n = chunks * 32;
+		len -= n;
+		
+		vs1 = vs2 = prev = zero;
+		for (; chunks > 0; chunks--, p += 32) {
+			v = _mm256_loadu_si256 ((const __m256i *) p);
+			
+			prev = _mm256_add_epi32 (prev, vs1);
+			vs1 = _mm256_add_epi32 (vs1, _mm256_sad_epu8 (v, zero));
+			vs2 = _mm256_add_epi32 (vs2, _mm256_madd_epi16 (_mm256_maddubs_epi16 (v, weights), ones));
+		}
+		
+		_mm256_storeu_si256 ((__m256i *) l1, vs1);
+		_mm256_storeu_si256 ((__m256i *) l2, vs2);
+		_mm256_storeu_si256 ((__m256i *) lp, prev);
+		
+		s1 = s2 = 0;
+		for (g = 0; g < 8; g++) {
+			s1 += l1[g];
+			s2 += l2[g] + 32 * (uint64_t) lp[g];
+		}
+		
+		c1 = (c1 + n * c0 + s2) % 255;
+		c0 = (c0 + s1) % 255;
+	}
+	
+	*c0_ = c0;
+	*c1_ = c1;
+	
+	_fletcher_sums_word (p, len, c0_, c1_);
+}
+#endif
+
+static void _fletcher_sums_resolve (const uint8_t *p, size_t len, uint32_t *c0, uint32_t *c1);
+
+/* Chosen on the first call, like csum_continue() */
+static void (*_fletcher_sums) (const uint8_t *p, size_t len, uint32_t *c0, uint32_t *c1) = _fletcher_sums_resolve;
+
+static void _fletcher_sums_resolve (const uint8_t *p, size_t len, uint32_t *c0, uint32_t *c1) {
+	_fletcher_sums = _fletcher_sums_word;
+#ifdef CSUM_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2")) {
+		_fletcher_sums = _fletcher_sums_avx2;
+	} else if (__builtin_cpu_supports ("ssse3")) {
+		_fletcher_sums = _fletcher_sums_ssse3;
+	}
+#endif
+	
+	_fletcher_sums (p, len, c0, c1);
+}
+
+/* Checks a received LSA (without its age field, like fletcher_checksum()
+ * is called): both sums are 0 when the stored checksum is right.
+ * Returns 1 if valid, 0 if not. */
+int fletcher_checksum_valid (const unsigned char *buffer, size_t len) {
+	uint32_t c0 = 0, c1 = 0;
+	
+	_fletcher_sums (buffer, len, &c0, &c1);
+	
+	return c0 == 0 && c1 == 0;
+}
 
 /* To be consistent, offset is 0-based index, rather than the 1-based 
    index required in the specification ISO 8473, Annex C.1 */
 /* calling with offset == FLETCHER_CHECKSUM_VALIDATE will validate the checksum
    without modifying the buffer; a valid checksum returns 0 */
 uint16_t fletcher_checksum(unsigned char * buffer, const size_t len, const uint16_t offset) {
-  uint8_t *p;
-  int x, y, c0, c1;
+  int x, y;
+  uint32_t c0, c1;
   uint16_t checksum;
   uint16_t *csum;
-  size_t partial_len, i, left = len;
   
   checksum = 0;
 
@@ -147,25 +472,10 @@ uint16_t fletcher_checksum(unsigned char * buffer, const size_t len, const uint1
       *(csum) = 0;
     }
 
-  p = buffer;
   c0 = 0;
   c1 = 0;
 
-  while (left != 0)
-    {
-      partial_len = MIN(left, MODX);
-
-      for (i = 0; i < partial_len; i++)
-	{
-	  c0 = c0 + *(p++);
-	  c1 += c0;
-	}
-
-      c0 = c0 % 255;
-      c1 = c1 % 255;
-
-      left -= partial_len;
-    }
+  _fletcher_sums (buffer, len, &c0, &c1);
 
   /* The cast is important, to ensure the mod is taken as a signed value. */
   x = (int)((len - offset - 1) * c0 - c1) % 255;
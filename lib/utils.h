@@ -14,8 +14,10 @@ uint32_t csum_add16 (uint32_t partial, uint16_t new);
 uint32_t csum_add32 (uint32_t partial, uint32_t new);
 uint32_t csum_continue (uint32_t partial, const void *data_, size_t n);
 uint16_t csum_finish (uint32_t partial);
+uint16_t csum_replace (uint16_t check, const void *old_, const void *new_, size_t n);
 
 struct timespec timespec_diff (struct timespec start, struct timespec end);
 uint16_t fletcher_checksum(unsigned char * buffer, const size_t len, const uint16_t offset);
+int fletcher_checksum_valid (const unsigned char *buffer, size_t len);
 
 #endif
@@ -36,6 +36,11 @@
 
 #include "glist.h"
 #include "netwatcher.h"
+#include "event-loop.h"
+#include "uring.h"
+#include "packet-ring.h"
+#include "lsa-arrival.h"
+#include "latency-histogram.h"
 
 #ifndef FALSE
 #define FALSE 0
@@ -51,6 +56,12 @@ enum {
 	OSPF_ISM_DROther
 };
 
+/* Router LSA más grande posible: 16 enlaces con 16 TOS cada uno */
+#define LSA_IMAGE_SIZE 1280
+
+/* Enlaces que caben en nuestro Router LSA */
+#define LSA_ROUTER_MAX_LINKS 16
+
 enum {
 	LSA_ROUTER_LINK_TRANSIT = 2,
 	LSA_ROUTER_LINK_STUB = 3
@@ -96,6 +107,12 @@ typedef struct {
 	uint16_t length;
 } ShortLSA;
 
+/* Una cabecera de LSA dentro de un paquete recibido. Sus campos se leen
+ * con los lsa_view_*, directo del buffer y sin modificarlo */
+typedef struct {
+	const unsigned char *data;
+} LSAView;
+
 typedef struct {
 	struct in_addr link_id;
 	struct in_addr data;
@@ -113,7 +130,7 @@ typedef struct {
 	uint8_t flags;
 	
 	uint16_t n_links;
-	LSARouterLink links[16];
+	LSARouterLink links[LSA_ROUTER_MAX_LINKS];
 } LSARouter;
 
 /*typedef struct {
@@ -132,8 +149,16 @@ typedef struct {
 	
 	int need_update;
 	
+	/* Número de secuencia visto en un vecino, pendiente de superar en la siguiente instancia */
+	uint32_t peer_seq_num;
+	int peer_seq_pending;
+	
 	struct timespec age_timestamp;
 	
+	/* El LSA en formato de red, listo para enviarse como un segmento */
+	unsigned char image[LSA_IMAGE_SIZE];
+	uint16_t image_len;
+	
 	union {
 		LSARouter router;
 	};
@@ -152,12 +177,20 @@ typedef struct {
 
 	/* OSPF packet length. */
 	uint16_t length;
+	
+	/* Kernel receive time, converted to CLOCK_MONOTONIC. */
+	struct timespec rx_time;
 } OSPFPacket;
 
+struct _OSPFMini;
+struct _OSPFLink;
+
 typedef struct {
 	struct in_addr router_id;
 	struct in_addr neigh_addr;
 	
+	struct _OSPFLink *ospf_link;
+	
 	int priority;
 	int way;
 	
@@ -169,8 +202,8 @@ typedef struct {
 	uint8_t dd_flags;
 	int dd_sent;
 	
-	/* Last sent Database Description packet. */
-	OSPFPacket dd_last_sent;
+	/* Last sent Database Description packet, a reference from the socket packet pool. */
+	OSPFPacket *dd_last_sent;
 	/* Timestemp when last Database Description packet was sent */
 	struct timespec dd_last_sent_time;
 	struct timespec request_last_sent_time;
@@ -187,12 +220,29 @@ typedef struct {
 	int requests_pending;
 	
 	GList *updates;
+	
+	/* Timers de inactividad y retransmisión */
+	Timer inactivity_timer;
+	Timer dd_timer;
+	Timer request_timer;
+	Timer update_timer;
+	
+	/* Intervalo de retransmisión actual de cada timer, 0 para empezar en RxmtInterval */
+	long dd_rxmt_msec;
+	long request_rxmt_msec;
+	long update_rxmt_msec;
 } OSPFNeighbor;
 
-typedef struct {
+typedef struct _OSPFLink {
+	struct _OSPFMini *miniospf;
+	
 	Interface *iface;
 	IPAddr *main_addr;
 	
+	/* El socket compartido, o uno propio atado a la interfaz con SO_BINDTODEVICE */
+	int socket;
+	EventLoopWatch *socket_watch;
+	
 	uint32_t area;
 	uint8_t area_type;
 	
@@ -200,12 +250,31 @@ typedef struct {
 	uint32_t dead_router_interval;
 	int cost;
 	
+	/* Los intervalos reales en milisegundos, distintos de los del paquete en modo fast-hello */
+	long hello_interval_msec;
+	long dead_interval_msec;
+	
+	/* RxmtInterval y el tope del backoff de retransmisiones, en milisegundos */
+	long rxmt_interval_msec;
+	long rxmt_max_msec;
+	
 	GList *neighbors;
 	struct in_addr designated;
 	struct in_addr backup;
 	
 	struct timespec waiting_time;
 	int state;
+	
+	Timer hello_timer;
+	Timer wait_timer;
+	
+	/* Hello fuera de intervalo ante vecinos nuevos o cambios de DR/BDR */
+	Timer triggered_hello_timer;
+	Throttle hello_throttle;
+	
+	/* El hello ya armado. Los cambios de vecinos y de DR/BDR se parchan en su lugar,
+	 * NULL para armarlo completo en el siguiente envío */
+	OSPFPacket *hello;
 } OSPFLink;
 
 typedef struct {
@@ -221,10 +290,44 @@ typedef struct {
 	uint16_t hello_interval;
 	uint32_t dead_router_interval;
 	
+	/* Si es mayor que cero, dead interval de 1 segundo con "hello_multiplier" hellos por segundo */
+	int hello_multiplier;
+	
+	/* Porcentaje máximo de jitter para hellos y retransmisiones */
+	int jitter_percent;
+	
+	/* Retransmisiones a vecinos: intervalo inicial y máximo del backoff, en milisegundos */
+	long rxmt_interval_msec;
+	long rxmt_max_msec;
+	
+	/* Throttle para generar nuestros LSA, en milisegundos */
+	long lsa_throttle_initial;
+	long lsa_throttle_hold;
+	long lsa_throttle_max;
+	
+	/* Leer y escribir los sockets con io_uring en lugar de recvmsg/sendmsg */
+	int use_uring;
+	
+	/* Buffers del kernel del socket OSPF, en bytes */
+	int socket_rcvbuf;
+	int socket_sndbuf;
+	
+	/* Clase de tráfico de los paquetes OSPF: DSCP en la cabecera IP y prioridad local (SO_PRIORITY) */
+	int socket_dscp;
+	int socket_priority;
+	
+	/* Recibir por un anillo AF_PACKET TPACKET_V3: tamaño en bytes y espera de cada bloque */
+	int use_packet_ring;
+	unsigned int packet_ring_size;
+	unsigned int packet_ring_timeout;
+	
+	/* Un socket raw por cada enlace, atado a su interfaz */
+	int socket_per_link;
+	
 	int cost;
 } OSPFConfig;
 
-typedef struct {
+typedef struct _OSPFMini {
 	NetworkWatcher *watcher;
 	OSPFConfig config;
 	
@@ -234,11 +337,42 @@ typedef struct {
 	int socket;
 	int has_nonblocking;
 	
+	/* Lector de los sockets propios de cada enlace */
+	EventLoopFdCB link_socket_cb;
+	
+	/* Despierta el ciclo para reintentar la cola de salida */
+	Timer send_retry_timer;
+	
+	/* Activo solo si se pidió y el kernel lo soporta */
+	URing uring;
+	int use_uring;
+	
+	/* El recvmsg multishot falló y el socket OSPF se lee otra vez con epoll */
+	int uring_fallen_back;
+	
+	/* Anillo de recepción, activo solo si se pidió y se pudo crear */
+	PacketRing packet_ring;
+	int use_packet_ring;
+	
 	OSPFLink *ospf_link;
 	
 	Interface *dummy_iface;
 	
 	CompleteLSA router_lsa;
+	
+	TimerQueue timers;
+	EventLoop loop;
+	Timer lsa_refresh_timer;
+	
+	Throttle lsa_throttle;
+	Timer lsa_throttle_timer;
+	
+	/* Última llegada de cada LSA recibido, para MinLSArrival */
+	LSAArrivalTable lsa_arrivals;
+	int lsa_dirty;
+	
+	/* Tiempo entre la llegada al kernel y el procesamiento de cada paquete */
+	LatencyHistogram rx_latency;
 } OSPFMini;
 
 typedef struct {
@@ -273,10 +407,8 @@ typedef struct {
 	uint32_t dd_seq;
 	
 	int n_lsas;
-	ShortLSA *lsas;
+	const unsigned char *lsas;
 } OSPFDD;
 
-extern int sigterm_pipe_fds[2];
-
 #endif /* __COMMON_H__ */
 
@@ -53,6 +53,9 @@ void lsa_populate_router (OSPFMini *miniospf) {
 			
 			if (addr->family != AF_INET) continue;
 			
+			/* Dejar lugar para el enlace OSPF, las demás IP no caben en el LSA */
+			if (lsa->router.n_links >= LSA_ROUTER_MAX_LINKS - 1) break;
+			
 			/* Agarrar la IP, aplicar la máscara, para sacar la red */
 			netmask = netmask4 (addr->prefix);
 			memcpy (&net_id, &addr->sin_addr.s_addr, sizeof (uint32_t));
@@ -191,52 +194,81 @@ int lsa_write_lsa (unsigned char *buffer, CompleteLSA *lsa) {
 	return pos;
 }
 
-void lsa_write_lsa_header (unsigned char *buffer, CompleteLSA *lsa) {
-	int pos;
-	uint32_t t32;
+/* Pone la edad actual en la imagen del LSA antes de enviarla.
+ * La edad no entra en el checksum, el resto de la imagen no cambia */
+int lsa_image_set_age (CompleteLSA *lsa) {
 	uint16_t t16;
-	int g, h;
 	
-	pos = 0;
+	t16 = htons (lsa_get_age (lsa));
+	memcpy (&lsa->image[0], &t16, sizeof (uint16_t));
 	
-	t16 = htonl (lsa_get_age (lsa));
-	memcpy (&buffer[pos], &t16, sizeof (uint16_t));
-	pos += 2;
+	return lsa->image_len;
+}
+
+/* La cabecera de un LSA propio, copiada de su imagen */
+void lsa_write_image_header (unsigned char *buffer, CompleteLSA *lsa) {
+	lsa_image_set_age (lsa);
+	memcpy (buffer, lsa->image, 20);
+}
+
+/* Serializa el LSA en su imagen, solo cuando cambia su contenido.
+ * Los envíos reutilizan la imagen y únicamente le ponen la edad */
+void lsa_finish_lsa_info (CompleteLSA *lsa) {
+	uint16_t checksum;
 	
-	buffer[pos++] = lsa->options;
-	buffer[pos++] = lsa->type;
+	lsa->image_len = lsa_write_lsa (lsa->image, lsa);
 	
-	memcpy (&buffer[pos], &lsa->link_state_id.s_addr, sizeof (uint32_t));
-	pos += 4;
-	
-	memcpy (&buffer[pos], &lsa->advert_router.s_addr, sizeof (uint32_t));
-	pos += 4;
+	lsa->length = lsa->image_len;
+	memcpy (&checksum, &lsa->image[16], sizeof (checksum));
+	lsa->checksum = checksum;
+}
+
+void lsa_refresh_timer_cb (void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
 	
-	t32 = htonl (lsa->seq_num);
-	memcpy (&buffer[pos], &t32, sizeof (uint32_t));
-	pos += 4;
+	/* Nuestro LSA ha envejecido mas de treinta minutos, renovarlo */
+	lsa_update_router_lsa (miniospf);
+}
+
+/* Un vecino tiene una instancia de nuestro LSA más nueva que la nuestra.
+ * Solo se guarda su número de secuencia, el LSA y su imagen no cambian
+ * hasta que el throttle genere la siguiente instancia por encima de él */
+void lsa_set_peer_seq_num (CompleteLSA *lsa, uint32_t seq_num) {
+	if (lsa->peer_seq_pending && (int) lsa->peer_seq_num >= (int) seq_num) return;
+	
+	lsa->peer_seq_num = seq_num;
+	lsa->peer_seq_pending = 1;
+}
+
+static uint32_t _lsa_next_seq_num (CompleteLSA *lsa) {
+	uint32_t seq_num;
 	
-	/* Aquí va el checksum */
-	t16 = lsa->checksum;
-	memcpy (&buffer[pos], &t16, sizeof (uint16_t));
-	pos += 2;
+	seq_num = lsa->seq_num;
+	if (lsa->peer_seq_pending) {
+		if ((int) lsa->peer_seq_num > (int) seq_num) seq_num = lsa->peer_seq_num;
+		lsa->peer_seq_pending = 0;
+	}
 	
-	/* Aquí se guarda la posición del total de la longitud */
-	t16 = htons (lsa->length);
-	memcpy (&buffer[pos], &t16, sizeof (uint16_t));
-	pos += 2;
+	return seq_num + 1;
 }
 
-void lsa_finish_lsa_info (CompleteLSA *lsa) {
-	unsigned char buffer_lsa[2048];
-	int len;
-	uint16_t checksum;
+static void _lsa_throttle_timer_cb (void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
 	
-	len = lsa_write_lsa (buffer_lsa, lsa);
+	throttle_fired (&miniospf->lsa_throttle);
 	
-	lsa->length = len;
-	memcpy (&checksum, &buffer_lsa[16], sizeof (checksum));
-	lsa->checksum = checksum;
+	lsa_update_router_lsa (miniospf);
+}
+
+/* Programar la generación del Router LSA a través del throttle,
+ * así una ráfaga de cambios de red produce una sola instancia */
+void lsa_schedule_router_lsa (OSPFMini *miniospf) {
+	if (timers_is_pending (&miniospf->lsa_throttle_timer)) {
+		/* Ya hay una generación programada, este cambio viaja en ella */
+		return;
+	}
+	
+	timers_add_msec (&miniospf->timers, &miniospf->lsa_throttle_timer, throttle_next_delay (&miniospf->lsa_throttle));
 }
 
 void lsa_update_router_lsa (OSPFMini *miniospf) {
@@ -247,7 +279,7 @@ void lsa_update_router_lsa (OSPFMini *miniospf) {
 	
 	lsa_populate_router (miniospf);
 	
-	miniospf->router_lsa.seq_num++;
+	miniospf->router_lsa.seq_num = _lsa_next_seq_num (&miniospf->router_lsa);
 	miniospf->router_lsa.need_update = 1;
 	
 	miniospf->router_lsa.age = 1;
@@ -255,6 +287,9 @@ void lsa_update_router_lsa (OSPFMini *miniospf) {
 	miniospf->router_lsa.age_timestamp = now;
 	
 	lsa_finish_lsa_info (&miniospf->router_lsa);
+	
+	/* Programar la siguiente renovación del LSA */
+	timers_add_msec (&miniospf->timers, &miniospf->lsa_refresh_timer, (OSPF_LSA_REFRESH_TIME - miniospf->router_lsa.age + 1) * 1000);
 }
 
 void lsa_init_router_lsa (OSPFMini *miniospf) {
@@ -283,25 +318,87 @@ void lsa_init_router_lsa (OSPFMini *miniospf) {
 	}
 	miniospf->router_lsa.seq_num = OSPF_INITIAL_SEQUENCE_NUMBER + 0;
 	
+	timers_init (&miniospf->lsa_throttle_timer, _lsa_throttle_timer_cb, miniospf);
+	throttle_init (&miniospf->lsa_throttle, miniospf->config.lsa_throttle_initial, miniospf->config.lsa_throttle_hold, miniospf->config.lsa_throttle_max);
+	
 	lsa_update_router_lsa (miniospf);
+	throttle_fired (&miniospf->lsa_throttle);
 }
 
-void lsa_create_complete_from_short (ShortLSA *dd, CompleteLSA *lsa) {
-	if (lsa == NULL || dd == NULL) return;
+/* Apunta "view" a la cabecera de LSA en buffer[pos], solo si cabe completa en los "len" bytes */
+int lsa_view_init (LSAView *view, const unsigned char *buffer, size_t len, size_t pos) {
+	if (pos > len || len - pos < 20) {
+		view->data = NULL;
+		
+		return -1;
+	}
+	
+	view->data = &buffer[pos];
 	
-	memset (lsa, 0, sizeof (CompleteLSA));
+	return 0;
+}
+
+uint16_t lsa_view_age (const LSAView *view) {
+	uint16_t t16;
 	
-	lsa->age = dd->age;
-	lsa->type = dd->type;
-	lsa->options = dd->options;
-	memcpy (&lsa->link_state_id.s_addr, &dd->link_state_id, sizeof (uint32_t));
-	memcpy (&lsa->advert_router.s_addr, &dd->advert_router, sizeof (uint32_t));
-	lsa->seq_num = dd->seq_num;
-	lsa->checksum = dd->checksum;
-	lsa->length = dd->length;
+	memcpy (&t16, &view->data[0], sizeof (uint16_t));
 	
-	/* Que este LSA empiece a envejecer */
-	clock_gettime (CLOCK_MONOTONIC, &lsa->age_timestamp);
+	return ntohs (t16);
+}
+
+uint8_t lsa_view_options (const LSAView *view) {
+	return view->data[2];
+}
+
+uint8_t lsa_view_type (const LSAView *view) {
+	return view->data[3];
+}
+
+/* El link state id y el advertising router quedan en orden de red, como en CompleteLSA */
+uint32_t lsa_view_link_state_id (const LSAView *view) {
+	uint32_t t32;
+	
+	memcpy (&t32, &view->data[4], sizeof (uint32_t));
+	
+	return t32;
+}
+
+uint32_t lsa_view_advert_router (const LSAView *view) {
+	uint32_t t32;
+	
+	memcpy (&t32, &view->data[8], sizeof (uint32_t));
+	
+	return t32;
+}
+
+uint32_t lsa_view_seq_num (const LSAView *view) {
+	uint32_t t32;
+	
+	memcpy (&t32, &view->data[12], sizeof (uint32_t));
+	
+	return ntohl (t32);
+}
+
+/* El checksum también queda en orden de red */
+uint16_t lsa_view_checksum (const LSAView *view) {
+	uint16_t t16;
+	
+	memcpy (&t16, &view->data[16], sizeof (uint16_t));
+	
+	return t16;
+}
+
+uint16_t lsa_view_length (const LSAView *view) {
+	uint16_t t16;
+	
+	memcpy (&t16, &view->data[18], sizeof (uint16_t));
+	
+	return ntohs (t16);
+}
+
+/* Copia la cabecera tal como llegó, por ejemplo para el ACK */
+void lsa_view_write_header (unsigned char *buffer, const LSAView *view) {
+	memcpy (buffer, view->data, 20);
 }
 
 void lsa_create_short_from_complete (CompleteLSA *lsa, ShortLSA *ss) {
@@ -379,6 +476,37 @@ int lsa_more_recent_short (CompleteLSA *l1, ShortLSA *l2) {
 	return 0;
 }
 
+int lsa_more_recent_view (CompleteLSA *l1, const LSAView *l2) {
+	int r;
+	int x, y;
+	int age1, age2;
+	
+	/* compare LS sequence number. */
+	x = (int) l1->seq_num;
+	y = (int) lsa_view_seq_num (l2);
+	if (x > y) return 1;
+	if (x < y) return -1;
+	
+	/* compare LS checksum. */
+	r = ntohs (l1->checksum) - ntohs (lsa_view_checksum (l2));
+	if (r) return r;
+	
+	age1 = LSA_AGE (l1);
+	age2 = lsa_view_age (l2);
+	if (age2 > OSPF_LSA_MAXAGE) age2 = OSPF_LSA_MAXAGE;
+	
+	/* compare LS age. */
+	if (age1 == OSPF_LSA_MAXAGE && age2 != OSPF_LSA_MAXAGE) return 1;
+	else if (age1 != OSPF_LSA_MAXAGE && age2 == OSPF_LSA_MAXAGE) return -1;
+	
+	/* compare LS age with MaxAgeDiff. */
+	if (age1 - age2 > OSPF_LSA_MAXAGE_DIFF) return -1;
+	else if (age2 - age1 > OSPF_LSA_MAXAGE_DIFF) return 1;
+	
+	/* LSAs are identical. */
+	return 0;
+}
+
 int lsa_match (CompleteLSA *l1, CompleteLSA *l2) {
 	if (l1 == NULL || l2 == NULL) return 1;
 	
@@ -415,19 +543,35 @@ int lsa_request_match (ReqLSA *l1, ReqLSA *l2) {
 	return 0;
 }
 
-int lsa_match_short_complete (CompleteLSA *l1, ShortLSA *l2) {
+int lsa_match_view (CompleteLSA *l1, const LSAView *l2) {
+	uint32_t t32;
+	
 	if (l1 == NULL || l2 == NULL) return 1;
 	
-	if (l1->type != l2->type) return 1;
+	if (l1->type != lsa_view_type (l2)) return 1;
 	
-	if (memcmp (&l1->link_state_id, &l2->link_state_id, sizeof (uint32_t)) != 0) return 1;
+	t32 = lsa_view_link_state_id (l2);
+	if (memcmp (&l1->link_state_id.s_addr, &t32, sizeof (uint32_t)) != 0) return 1;
 	
-	if (memcmp (&l1->advert_router, &l2->advert_router, sizeof (uint32_t)) != 0) return 1;
+	t32 = lsa_view_advert_router (l2);
+	if (memcmp (&l1->advert_router.s_addr, &t32, sizeof (uint32_t)) != 0) return 1;
 	
 	return 0;
 }
 
-int lsa_match_short_short (ShortLSA *l1, ShortLSA *l2) {
+int lsa_match_short_view (ShortLSA *l1, const LSAView *l2) {
+	if (l1 == NULL || l2 == NULL) return 1;
+	
+	if (l1->type != lsa_view_type (l2)) return 1;
+	
+	if (l1->link_state_id != lsa_view_link_state_id (l2)) return 1;
+	
+	if (l1->advert_router != lsa_view_advert_router (l2)) return 1;
+	
+	return 0;
+}
+
+int lsa_match_short_complete (CompleteLSA *l1, ShortLSA *l2) {
 	if (l1 == NULL || l2 == NULL) return 1;
 	
 	if (l1->type != l2->type) return 1;
@@ -447,11 +591,10 @@ void lsa_create_request_from_complete (CompleteLSA *lsa, ReqLSA *req) {
 	memcpy (&req->advert_router, &lsa->advert_router.s_addr, sizeof (uint32_t));
 }
 
-void lsa_create_request_from_short (ShortLSA *lsa, ReqLSA *req) {
+void lsa_create_request_from_view (const LSAView *lsa, ReqLSA *req) {
 	if (lsa == NULL || req == NULL) return;
 	
-	req->type = lsa->type;
-	memcpy (&req->link_state_id, &lsa->link_state_id, sizeof (uint32_t));
-	memcpy (&req->advert_router, &lsa->advert_router, sizeof (uint32_t));
+	req->type = lsa_view_type (lsa);
+	req->link_state_id = lsa_view_link_state_id (lsa);
+	req->advert_router = lsa_view_advert_router (lsa);
 }
-
@@ -25,7 +25,7 @@ void ospf_change_interface_delete (Interface *iface, void *arg) {
 	if (iface == miniospf->dummy_iface) {
 		/* La interfaz dummy desaparece. Actualizar el Router LSA */
 		miniospf->dummy_iface = NULL;
-		lsa_update_router_lsa (miniospf);
+		miniospf->lsa_dirty = 1;
 	} else if (miniospf->ospf_link != NULL) {
 		if (iface == miniospf->ospf_link->iface) {
 			/* Esto es un problema. Sin la interfaz principal activa, no hay loop principal */
@@ -43,10 +43,8 @@ void ospf_change_address_delete (Interface *iface, IPAddr *addr, void *arg) {
 	
 	if (addr->family != AF_INET) return;
 	
-	if (iface == miniospf->dummy_iface) {
-		/* La interfaz dummy pierde una IP, actualizar el Router LSA */
-		lsa_update_router_lsa (miniospf);
-	} else if (miniospf->ospf_link != NULL) {
+	/* Las IP de la interfaz dummy se revisan al final del lote en ospf_change_settled */
+	if (iface != miniospf->dummy_iface && miniospf->ospf_link != NULL) {
 		/* Esto *podría* ser un problema.
 		 * Si la dirección principal es eliminada, y no hay otras IP
 		 * no hay forma de comunicación con los otros routers */
@@ -71,10 +69,8 @@ void ospf_change_address_add (Interface *iface, IPAddr *addr, void *arg) {
 	
 	memset (&addr_zero, 0, sizeof (addr_zero));
 	
-	if (iface == miniospf->dummy_iface) {
-		/* La interfaz dummy gana una IP, actualizar el Router LSA */
-		lsa_update_router_lsa (miniospf);
-	} else if (miniospf->ospf_link == NULL) {
+	/* Las IP de la interfaz dummy se revisan al final del lote en ospf_change_settled */
+	if (iface != miniospf->dummy_iface && miniospf->ospf_link == NULL) {
 		/* Si no tenemos ospf_link, y agregaron una IP, intentar recrear el enlace */
 		if (memcmp (&miniospf->config.link_addr, &addr_zero, sizeof (struct in_addr)) != 0 &&
 		    memcmp (&miniospf->config.link_addr, &addr->sin_addr, sizeof (struct in_addr)) == 0) {
@@ -98,6 +94,32 @@ void ospf_change_address_add (Interface *iface, IPAddr *addr, void *arg) {
 	}
 }
 
+/* Se llama una vez que se leyeron todos los eventos de red pendientes.
+ * Los manejadores individuales solo hacen el trabajo estructural del enlace,
+ * aquí se decide si el Router LSA cambió, una sola vez por lote */
+void ospf_change_settled (GList *changes, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	NetworkChange *change;
+	GList *g;
+	
+	for (g = changes; g != NULL; g = g->next) {
+		change = (NetworkChange *) g->data;
+		
+		if (change->type != NETWORK_CHANGE_ADDRESS_ADDED && change->type != NETWORK_CHANGE_ADDRESS_DELETED) continue;
+		if (change->addr.family != AF_INET) continue;
+		
+		if (miniospf->dummy_iface != NULL && change->ifindex == miniospf->dummy_iface->index) {
+			/* La interfaz dummy ganó o perdió una IP */
+			miniospf->lsa_dirty = 1;
+		}
+	}
+	
+	if (miniospf->lsa_dirty) {
+		miniospf->lsa_dirty = 0;
+		lsa_schedule_router_lsa (miniospf);
+	}
+}
+
 void ospf_change_interface_up (Interface *iface, void *arg) {
 	OSPFMini *miniospf = (OSPFMini *) arg;
 	struct timespec now;
@@ -111,7 +133,9 @@ void ospf_change_interface_up (Interface *iface, void *arg) {
 			miniospf->ospf_link->state = OSPF_ISM_Waiting;
 			miniospf->ospf_link->waiting_time = now;
 			
-			ospf_send_hello (miniospf);
+			timers_add_msec (&miniospf->timers, &miniospf->ospf_link->wait_timer, miniospf->ospf_link->dead_interval_msec);
+			
+			ospf_trigger_hello (miniospf, miniospf->ospf_link);
 		}
 	}
 }
@@ -136,6 +160,7 @@ void ospf_change_interface_down (Interface *iface, void *arg) {
 			}
 			
 			miniospf->ospf_link->state = OSPF_ISM_Down;
+			timers_cancel (&miniospf->timers, &miniospf->ospf_link->wait_timer);
 		}
 	}
 }
@@ -6,6 +6,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "common.h"
 
@@ -20,23 +21,36 @@
 #define IS_SET_DD_I(X)          ((X) & OSPF_DD_FLAG_I)
 #define IS_SET_DD_ALL(X)        ((X) & OSPF_DD_FLAG_ALL)
 
+/* Tiempo mínimo entre dos instancias aceptadas del mismo LSA, en milisegundos */
+#define OSPF_MIN_LS_ARRIVAL 1000
+
+/* Hellos adelantados: espera para juntar varios disparos y separación mínima entre dos, en milisegundos */
+#define OSPF_TRIGGERED_HELLO_DELAY 10
+#define OSPF_TRIGGERED_HELLO_HOLD 1000
+
+/* Posiciones en el hello del DR (seguido del BDR) y de la lista de vecinos:
+ * cabecera (24), máscara, hello interval, opciones, prioridad y dead interval */
+#define OSPF_HELLO_DR_POS 36
+#define OSPF_HELLO_NEIGHBORS_POS 44
+
 void ospf_configure_router_id (OSPFMini *miniospf);
 OSPFLink *ospf_create_iface (OSPFMini *miniospf, Interface *iface, IPAddr *main_addr);
 void ospf_destroy_link (OSPFMini *miniospf, OSPFLink *ospf_link);
 int ospf_validate_header (unsigned char *buffer, uint16_t len, OSPFHeader *header);
 void ospf_send_hello (OSPFMini *miniospf);
+void ospf_trigger_hello (OSPFMini *miniospf, OSPFLink *ospf_link);
 void ospf_dr_election (OSPFMini *miniospf, OSPFLink *ospf_link);
 void ospf_process_hello (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_send_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino);
 void ospf_process_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_fill_header (int type, char *buffer, struct in_addr *router_id, uint32_t area);
 void ospf_fill_header_end (char *buffer, uint16_t len);
+void ospf_fill_header_end_segments (unsigned char *buffer, uint16_t header_len, struct iovec *segments, int n_segments);
 void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_send_update_router_link (OSPFMini *miniospf);
 void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_neighbor_state_change (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino, int state);
 void ospf_send_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino);
-void ospf_check_neighbors (OSPFMini *miniospf, struct timespec now);
 void ospf_del_neighbor (OSPFLink *ospf_link, OSPFNeighbor *vecino);
 void ospf_process_ack (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 
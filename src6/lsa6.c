@@ -55,6 +55,7 @@ void lsa_create_router (OSPFMini *miniospf, CompleteLSA *lsa) {
 	lsa->link_state_id = 0; /* Los routers LSA siempre llevan 0 */
 	lsa->advert_router = miniospf->config.router_id;
 	lsa->seq_num = OSPF_INITIAL_SEQUENCE_NUMBER;
+	lsa->peer_seq_pending = 0;
 	lsa->checksum = 0;
 	lsa->length = 24;
 	if (ospf_has_full_dr (miniospf)) {
@@ -106,6 +107,7 @@ void lsa_create_link_local (OSPFMini *miniospf, CompleteLSA *lsa) {
 	lsa->link_state_id = miniospf->ospf_link->iface->index;
 	lsa->advert_router = miniospf->config.router_id;
 	lsa->seq_num = OSPF_INITIAL_SEQUENCE_NUMBER;
+	lsa->peer_seq_pending = 0;
 	lsa->checksum = 0;
 	lsa->length = 44;
 	if (ospf_has_full_dr (miniospf)) {
@@ -129,6 +131,9 @@ void lsa_create_link_local (OSPFMini *miniospf, CompleteLSA *lsa) {
 		
 		if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) continue;
 		
+		/* Las demás direcciones no caben en el LSA */
+		if (lsa->link.n_prefixes >= LSA_MAX_PREFIXES) break;
+		
 		prefix = &lsa->link.prefixes[lsa->link.n_prefixes];
 		
 		prefix->prefix_len = addr->prefix;
@@ -162,6 +167,7 @@ void lsa_create_intra_area_prefix (OSPFMini *miniospf, CompleteLSA *lsa) {
 	lsa->link_state_id = 0;
 	lsa->advert_router = miniospf->config.router_id;
 	lsa->seq_num = OSPF_INITIAL_SEQUENCE_NUMBER;
+	lsa->peer_seq_pending = 0;
 	lsa->checksum = 0;
 	lsa->length = 32;
 	if (ospf_has_full_dr (miniospf)) {
@@ -183,6 +189,9 @@ void lsa_create_intra_area_prefix (OSPFMini *miniospf, CompleteLSA *lsa) {
 		
 		if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) continue;
 		
+		/* Las demás direcciones no caben en el LSA */
+		if (lsa->intra_area_prefix.n_prefixes >= LSA_MAX_PREFIXES) break;
+		
 		prefix = &lsa->intra_area_prefix.prefixes[lsa->intra_area_prefix.n_prefixes];
 		
 		prefix->prefix_len = addr->prefix;
@@ -201,6 +210,91 @@ void lsa_create_intra_area_prefix (OSPFMini *miniospf, CompleteLSA *lsa) {
 	lsa_finish_lsa_info (lsa);
 }
 
+/* Un vecino tiene una instancia de nuestro LSA más nueva que la nuestra.
+ * Solo se guarda su número de secuencia, el LSA y su imagen no cambian
+ * hasta que el throttle genere la siguiente instancia por encima de él */
+void lsa_set_peer_seq_num (CompleteLSA *lsa, uint32_t seq_num) {
+	if (lsa->peer_seq_pending && (int) lsa->peer_seq_num >= (int) seq_num) return;
+	
+	lsa->peer_seq_num = seq_num;
+	lsa->peer_seq_pending = 1;
+}
+
+static uint32_t _lsa_next_seq_num (CompleteLSA *lsa) {
+	uint32_t seq_num;
+	
+	seq_num = lsa->seq_num;
+	if (lsa->peer_seq_pending) {
+		if ((int) lsa->peer_seq_num > (int) seq_num) seq_num = lsa->peer_seq_num;
+		lsa->peer_seq_pending = 0;
+	}
+	
+	return seq_num + 1;
+}
+
+static void _lsa_throttle_timer_cb (void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	int dirty;
+	int g;
+	
+	dirty = miniospf->lsa_dirty;
+	miniospf->lsa_dirty = 0;
+	
+	throttle_fired (&miniospf->lsa_throttle);
+	
+	/* Generar una sola instancia de cada LSA marcado, sin importar cuántos cambios se juntaron */
+	if (dirty & LSA_DIRTY_LINK) {
+		lsa_update_link_local (miniospf);
+	}
+	
+	if (dirty & LSA_DIRTY_INTRA_AREA_PREFIX) {
+		lsa_update_intra_area_prefix (miniospf);
+	}
+	
+	if (dirty & LSA_DIRTY_ROUTER) {
+		lsa_update_router_lsa (miniospf);
+	}
+	
+	/* El Router LSA solo cambia de instancia si cambió su contenido.
+	 * Si un vecino tiene una más nueva, renovarlo para superarla */
+	for (g = 0; g < miniospf->n_lsas; g++) {
+		if (!miniospf->lsas[g].peer_seq_pending) continue;
+		
+		lsa_refresh_lsa (&miniospf->lsas[g], miniospf->lsas[g].seq_num);
+		if (ospf_has_full_dr (miniospf)) {
+			miniospf->lsas[g].need_update = 1;
+		}
+	}
+}
+
+/* Bandera de regeneración que corresponde a cada tipo de LSA propio */
+int lsa_dirty_for_type (uint16_t type) {
+	switch (type) {
+		case LSA_ROUTER:
+			return LSA_DIRTY_ROUTER;
+		case LSA_INTRA_AREA_PREFIX:
+			return LSA_DIRTY_INTRA_AREA_PREFIX;
+		case LSA_LINK:
+			return LSA_DIRTY_LINK;
+	}
+	
+	return 0;
+}
+
+/* Marcar LSA para regenerar y programar la generación a través del throttle */
+void lsa_schedule_update (OSPFMini *miniospf, int dirty) {
+	miniospf->lsa_dirty |= dirty;
+	
+	if (miniospf->lsa_dirty == 0) return;
+	
+	if (timers_is_pending (&miniospf->lsa_throttle_timer)) {
+		/* Ya hay una generación programada, este cambio viaja en ella */
+		return;
+	}
+	
+	timers_add_msec (&miniospf->timers, &miniospf->lsa_throttle_timer, throttle_next_delay (&miniospf->lsa_throttle));
+}
+
 void lsa_populate_init (OSPFMini *miniospf) {
 	struct timespec now;
 	CompleteLSA *lsa;
@@ -208,6 +302,11 @@ void lsa_populate_init (OSPFMini *miniospf) {
 	
 	clock_gettime (CLOCK_MONOTONIC, &now);
 	
+	timers_init (&miniospf->lsa_throttle_timer, _lsa_throttle_timer_cb, miniospf);
+	throttle_init (&miniospf->lsa_throttle, miniospf->config.lsa_throttle_initial, miniospf->config.lsa_throttle_hold, miniospf->config.lsa_throttle_max);
+	throttle_fired (&miniospf->lsa_throttle);
+	miniospf->lsa_dirty = 0;
+	
 	printf ("Llamando Populate LSA Init\n");
 	
 	/* Construir todos los LSA desde cero */
@@ -406,50 +505,108 @@ int lsa_write_lsa (unsigned char *buffer, CompleteLSA *lsa) {
 	return pos;
 }
 
-void lsa_write_lsa_header (unsigned char *buffer, CompleteLSA *lsa) {
-	int pos;
-	uint32_t t32;
+/* Pone la edad actual en la imagen del LSA antes de enviarla.
+ * La edad no entra en el checksum, el resto de la imagen no cambia */
+int lsa_image_set_age (CompleteLSA *lsa) {
 	uint16_t t16;
 	
-	pos = 0;
-	
 	t16 = htons (lsa_get_age (lsa));
-	memcpy (&buffer[pos], &t16, sizeof (uint16_t));
-	pos += 2;
+	memcpy (&lsa->image[0], &t16, sizeof (uint16_t));
 	
-	t16 = htons (lsa->type);
-	memcpy (&buffer[pos], &t16, sizeof (uint16_t));
-	pos += 2;
+	return lsa->image_len;
+}
+
+/* La cabecera de un LSA propio, copiada de su imagen */
+void lsa_write_image_header (unsigned char *buffer, CompleteLSA *lsa) {
+	lsa_image_set_age (lsa);
+	memcpy (buffer, lsa->image, 20);
+}
+
+/* Apunta "view" a la cabecera de LSA en buffer[pos], solo si cabe completa en los "len" bytes */
+int lsa_view_init (LSAView *view, const unsigned char *buffer, size_t len, size_t pos) {
+	if (pos > len || len - pos < 20) {
+		view->data = NULL;
+		
+		return -1;
+	}
 	
-	t32 = htonl (lsa->link_state_id);
-	memcpy (&buffer[pos], &t32, sizeof (uint32_t));
-	pos += 4;
+	view->data = &buffer[pos];
 	
-	memcpy (&buffer[pos], &lsa->advert_router, sizeof (uint32_t));
-	pos += 4;
+	return 0;
+}
+
+uint16_t lsa_view_age (const LSAView *view) {
+	uint16_t t16;
 	
-	t32 = htonl (lsa->seq_num);
-	memcpy (&buffer[pos], &t32, sizeof (uint32_t));
-	pos += 4;
+	memcpy (&t16, &view->data[0], sizeof (uint16_t));
 	
-	/* Aquí va el checksum */
-	memcpy (&buffer[pos], &lsa->checksum, sizeof (uint16_t));
-	pos += 2;
+	return ntohs (t16);
+}
+
+uint16_t lsa_view_type (const LSAView *view) {
+	uint16_t t16;
 	
-	t16 = htons (lsa->length);
-	memcpy (&buffer[pos], &t16, sizeof (uint16_t));
-	pos += 2;
+	memcpy (&t16, &view->data[2], sizeof (uint16_t));
+	
+	return ntohs (t16);
 }
 
+uint32_t lsa_view_link_state_id (const LSAView *view) {
+	uint32_t t32;
+	
+	memcpy (&t32, &view->data[4], sizeof (uint32_t));
+	
+	return ntohl (t32);
+}
+
+/* El advertising router queda en orden de red, como en CompleteLSA */
+uint32_t lsa_view_advert_router (const LSAView *view) {
+	uint32_t t32;
+	
+	memcpy (&t32, &view->data[8], sizeof (uint32_t));
+	
+	return t32;
+}
+
+uint32_t lsa_view_seq_num (const LSAView *view) {
+	uint32_t t32;
+	
+	memcpy (&t32, &view->data[12], sizeof (uint32_t));
+	
+	return ntohl (t32);
+}
+
+/* El checksum también queda en orden de red */
+uint16_t lsa_view_checksum (const LSAView *view) {
+	uint16_t t16;
+	
+	memcpy (&t16, &view->data[16], sizeof (uint16_t));
+	
+	return t16;
+}
+
+uint16_t lsa_view_length (const LSAView *view) {
+	uint16_t t16;
+	
+	memcpy (&t16, &view->data[18], sizeof (uint16_t));
+	
+	return ntohs (t16);
+}
+
+/* Copia la cabecera tal como llegó, por ejemplo para el ACK */
+void lsa_view_write_header (unsigned char *buffer, const LSAView *view) {
+	memcpy (buffer, view->data, 20);
+}
+
+/* Serializa el LSA en su imagen, solo cuando cambia su contenido.
+ * Los envíos reutilizan la imagen y únicamente le ponen la edad */
 void lsa_finish_lsa_info (CompleteLSA *lsa) {
-	unsigned char buffer_lsa[2048];
-	int len;
 	uint16_t checksum;
 	
-	len = lsa_write_lsa (buffer_lsa, lsa);
+	lsa->image_len = lsa_write_lsa (lsa->image, lsa);
 	
-	lsa->length = len;
-	memcpy (&checksum, &buffer_lsa[16], sizeof (checksum));
+	lsa->length = lsa->image_len;
+	memcpy (&checksum, &lsa->image[16], sizeof (checksum));
 	lsa->checksum = checksum;
 }
 
@@ -522,7 +679,7 @@ void lsa_update_router_lsa (OSPFMini *miniospf) {
 	
 	if (was_updated == 1) {
 		clock_gettime (CLOCK_MONOTONIC, &now);
-		lsa->seq_num++;
+		lsa->seq_num = _lsa_next_seq_num (lsa);
 		lsa->age = 1;
 		if (ospf_has_full_dr (miniospf)) {
 			lsa->need_update = 1;
@@ -569,6 +726,9 @@ void lsa_update_intra_area_prefix (OSPFMini *miniospf) {
 			
 			if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) continue;
 			
+			/* Las demás direcciones no caben en el LSA */
+			if (lsa->intra_area_prefix.n_prefixes >= LSA_MAX_PREFIXES) break;
+			
 			prefix = &lsa->intra_area_prefix.prefixes[lsa->intra_area_prefix.n_prefixes];
 			
 			prefix->prefix_len = addr->prefix;
@@ -591,7 +751,7 @@ void lsa_update_intra_area_prefix (OSPFMini *miniospf) {
 		lsa->need_update = 0;
 	}
 	
-	lsa->seq_num = lsa->seq_num + 1;
+	lsa->seq_num = _lsa_next_seq_num (lsa);
 	lsa_finish_lsa_info (lsa);
 	
 	if (lsa->intra_area_prefix.n_prefixes == 0) {
@@ -655,6 +815,9 @@ void lsa_update_link_local (OSPFMini *miniospf) {
 		
 		if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) continue;
 		
+		/* Las demás direcciones no caben en el LSA */
+		if (lsa->link.n_prefixes >= LSA_MAX_PREFIXES) break;
+		
 		prefix = &lsa->link.prefixes[lsa->link.n_prefixes];
 		
 		prefix->prefix_len = addr->prefix;
@@ -675,7 +838,7 @@ void lsa_update_link_local (OSPFMini *miniospf) {
 	} else {
 		lsa->need_update = 0;
 	}
-	lsa->seq_num = lsa->seq_num + 1;
+	lsa->seq_num = _lsa_next_seq_num (lsa);
 	lsa->age = 1;
 	clock_gettime (CLOCK_MONOTONIC, &lsa->age_timestamp);
 	lsa_finish_lsa_info (lsa);
@@ -683,35 +846,74 @@ void lsa_update_link_local (OSPFMini *miniospf) {
 
 void lsa_refresh_lsa (CompleteLSA *lsa, uint32_t seq_num) {
 	printf ("Refrescando LSA: %i\n", lsa->type);
-	lsa->seq_num = seq_num + 1;
+	lsa->seq_num = seq_num;
+	lsa->seq_num = _lsa_next_seq_num (lsa);
 	lsa->age = 1;
 	clock_gettime (CLOCK_MONOTONIC, &lsa->age_timestamp);
 	lsa_finish_lsa_info (lsa);
 }
 
-void lsa_expire_lsa (CompleteLSA *lsa) {
-	if (lsa->age == 3600) {
-		/* Si ya estaba expirada, no expirar */
-		return;
+static int _lsa_needs_refresh (CompleteLSA *lsa) {
+	if (lsa->age >= OSPF_LSA_MAXAGE) {
+		/* Expirado a propósito, no renovar */
+		return 0;
 	}
-	lsa->age = 3600;
-	clock_gettime (CLOCK_MONOTONIC, &lsa->age_timestamp);
+	
+	if (lsa->type == LSA_INTRA_AREA_PREFIX && lsa->intra_area_prefix.n_prefixes == 0) {
+		return 0;
+	}
+	
+	return 1;
 }
 
-void lsa_create_complete_from_short (ShortLSA *dd, CompleteLSA *lsa) {
-	if (lsa == NULL || dd == NULL) return;
+/* Programar el timer de renovación para el LSA que envejezca primero */
+void lsa_schedule_refresh (OSPFMini *miniospf) {
+	struct timespec deadline, first;
+	int g, found;
 	
-	memset (lsa, 0, sizeof (CompleteLSA));
+	found = 0;
+	for (g = 0; g < miniospf->n_lsas; g++) {
+		if (!_lsa_needs_refresh (&miniospf->lsas[g])) continue;
+		
+		deadline = timespec_add_msec (miniospf->lsas[g].age_timestamp, (OSPF_LSA_REFRESH_TIME - miniospf->lsas[g].age + 1) * 1000L);
+		
+		if (found == 0 || timespec_cmp (deadline, first) < 0) {
+			first = deadline;
+			found = 1;
+		}
+	}
 	
-	lsa->age = dd->age;
-	lsa->type = dd->type;
-	lsa->link_state_id = dd->link_state_id;
-	lsa->advert_router = dd->advert_router;
-	lsa->seq_num = dd->seq_num;
-	lsa->checksum = dd->checksum;
-	lsa->length = dd->length;
+	if (found) {
+		timers_add_deadline (&miniospf->timers, &miniospf->lsa_refresh_timer, first);
+	} else {
+		timers_cancel (&miniospf->timers, &miniospf->lsa_refresh_timer);
+	}
+}
+
+void lsa_refresh_timer_cb (void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	int g;
+	
+	for (g = 0; g < miniospf->n_lsas; g++) {
+		/* Revisar si nuestro LSA ha envejecido mas de treinta minutos para renovarlo */
+		if (LSA_AGE (&miniospf->lsas[g]) > OSPF_LSA_REFRESH_TIME && _lsa_needs_refresh (&miniospf->lsas[g])) {
+			lsa_refresh_lsa (&miniospf->lsas[g], miniospf->lsas[g].seq_num);
+			
+			if (ospf_has_full_dr (miniospf)) {
+				miniospf->lsas[g].need_update = 1;
+			}
+		}
+	}
 	
-	/* Que este LSA empiece a envejecer */
+	lsa_schedule_refresh (miniospf);
+}
+
+void lsa_expire_lsa (CompleteLSA *lsa) {
+	if (lsa->age == 3600) {
+		/* Si ya estaba expirada, no expirar */
+		return;
+	}
+	lsa->age = 3600;
 	clock_gettime (CLOCK_MONOTONIC, &lsa->age_timestamp);
 }
 
@@ -789,6 +991,37 @@ int lsa_more_recent_short (CompleteLSA *l1, ShortLSA *l2) {
 	return 0;
 }
 
+int lsa_more_recent_view (CompleteLSA *l1, const LSAView *l2) {
+	int r;
+	int x, y;
+	int age1, age2;
+	
+	/* compare LS sequence number. */
+	x = (int) l1->seq_num;
+	y = (int) lsa_view_seq_num (l2);
+	if (x > y) return 1;
+	if (x < y) return -1;
+	
+	/* compare LS checksum. */
+	r = ntohs (l1->checksum) - ntohs (lsa_view_checksum (l2));
+	if (r) return r;
+	
+	age1 = LSA_AGE (l1);
+	age2 = lsa_view_age (l2);
+	if (age2 > OSPF_LSA_MAXAGE) age2 = OSPF_LSA_MAXAGE;
+	
+	/* compare LS age. */
+	if (age1 == OSPF_LSA_MAXAGE && age2 != OSPF_LSA_MAXAGE) return 1;
+	else if (age1 != OSPF_LSA_MAXAGE && age2 == OSPF_LSA_MAXAGE) return -1;
+	
+	/* compare LS age with MaxAgeDiff. */
+	if (age1 - age2 > OSPF_LSA_MAXAGE_DIFF) return -1;
+	else if (age2 - age1 > OSPF_LSA_MAXAGE_DIFF) return 1;
+	
+	/* LSAs are identical. */
+	return 0;
+}
+
 int lsa_match (CompleteLSA *l1, CompleteLSA *l2) {
 	if (l1 == NULL || l2 == NULL) return 1;
 	
@@ -837,14 +1070,26 @@ int lsa_match_short_complete (CompleteLSA *l1, ShortLSA *l2) {
 	return 0;
 }
 
-int lsa_match_short_short (ShortLSA *l1, ShortLSA *l2) {
+int lsa_match_view (CompleteLSA *l1, const LSAView *l2) {
 	if (l1 == NULL || l2 == NULL) return 1;
 	
-	if (l1->type != l2->type) return 1;
+	if (l1->type != lsa_view_type (l2)) return 1;
 	
-	if (memcmp (&l1->link_state_id, &l2->link_state_id, sizeof (uint32_t)) != 0) return 1;
+	if (l1->link_state_id != lsa_view_link_state_id (l2)) return 1;
 	
-	if (memcmp (&l1->advert_router, &l2->advert_router, sizeof (uint32_t)) != 0) return 1;
+	if (l1->advert_router != lsa_view_advert_router (l2)) return 1;
+	
+	return 0;
+}
+
+int lsa_match_short_view (ShortLSA *l1, const LSAView *l2) {
+	if (l1 == NULL || l2 == NULL) return 1;
+	
+	if (l1->type != lsa_view_type (l2)) return 1;
+	
+	if (l1->link_state_id != lsa_view_link_state_id (l2)) return 1;
+	
+	if (l1->advert_router != lsa_view_advert_router (l2)) return 1;
 	
 	return 0;
 }
@@ -857,11 +1102,12 @@ void lsa_create_request_from_complete (CompleteLSA *lsa, ReqLSA *req) {
 	req->advert_router = lsa->advert_router;
 }
 
-void lsa_create_request_from_short (ShortLSA *lsa, ReqLSA *req) {
+void lsa_create_request_from_view (const LSAView *lsa, ReqLSA *req) {
 	if (lsa == NULL || req == NULL) return;
 	
-	req->type = lsa->type;
-	req->link_state_id = lsa->link_state_id;
-	req->advert_router = lsa->advert_router;
+	req->reserved = 0;
+	req->type = lsa_view_type (lsa);
+	req->link_state_id = lsa_view_link_state_id (lsa);
+	req->advert_router = lsa_view_advert_router (lsa);
 }
 
@@ -16,29 +16,52 @@
 #define LSA_SHORT_AGE(x)      (OSPF_LSA_MAXAGE < lsa_short_get_age(x) ? OSPF_LSA_MAXAGE : lsa_short_get_age(x))
 #define IS_LSA_SHORT_MAXAGE(L)        (LSA_SHORT_AGE ((L)) == OSPF_LSA_MAXAGE)
 
+/* Banderas de los LSA pendientes de generar */
+#define LSA_DIRTY_ROUTER                0x01
+#define LSA_DIRTY_INTRA_AREA_PREFIX     0x02
+#define LSA_DIRTY_LINK                  0x04
+
 void lsa_populate_init (OSPFMini *miniospf);
+int lsa_dirty_for_type (uint16_t type);
+void lsa_schedule_update (OSPFMini *miniospf, int dirty);
+void lsa_set_peer_seq_num (CompleteLSA *lsa, uint32_t seq_num);
 void lsa_update_router_lsa (OSPFMini *miniospf);
 void lsa_update_intra_area_prefix (OSPFMini *miniospf);
 void lsa_update_link_local (OSPFMini *miniospf);
 int lsa_write_lsa (unsigned char *buffer, CompleteLSA *lsa);
-void lsa_write_lsa_header (unsigned char *buffer, CompleteLSA *lsa);
+int lsa_image_set_age (CompleteLSA *lsa);
+void lsa_write_image_header (unsigned char *buffer, CompleteLSA *lsa);
+
+/* Leer cabeceras de LSA recibidas sin modificar el paquete */
+int lsa_view_init (LSAView *view, const unsigned char *buffer, size_t len, size_t pos);
+uint16_t lsa_view_age (const LSAView *view);
+uint16_t lsa_view_type (const LSAView *view);
+uint32_t lsa_view_link_state_id (const LSAView *view);
+uint32_t lsa_view_advert_router (const LSAView *view);
+uint32_t lsa_view_seq_num (const LSAView *view);
+uint16_t lsa_view_checksum (const LSAView *view);
+uint16_t lsa_view_length (const LSAView *view);
+void lsa_view_write_header (unsigned char *buffer, const LSAView *view);
 void lsa_refresh_lsa (CompleteLSA *lsa, uint32_t seq_num);
 void lsa_expire_lsa (CompleteLSA *lsa);
+void lsa_schedule_refresh (OSPFMini *miniospf);
+void lsa_refresh_timer_cb (void *arg);
 
 /* Convertir LSA */
-void lsa_create_complete_from_short (ShortLSA *dd, CompleteLSA *lsa);
 void lsa_create_request_from_complete (CompleteLSA *lsa, ReqLSA *req);
 void lsa_create_short_from_complete (CompleteLSA *lsa, ShortLSA *req);
-void lsa_create_request_from_short (ShortLSA *lsa, ReqLSA *req);
+void lsa_create_request_from_view (const LSAView *lsa, ReqLSA *req);
 
 /* Funciones para comparar LSA */
 int lsa_match (CompleteLSA *l1, CompleteLSA *l2);
 int lsa_request_match (ReqLSA *l1, ReqLSA *l2);
 int lsa_match_req_complete (CompleteLSA *l1, ReqLSA *l2);
 int lsa_match_short_complete (CompleteLSA *l1, ShortLSA *l2);
-int lsa_match_short_short (ShortLSA *l1, ShortLSA *l2);
+int lsa_match_view (CompleteLSA *l1, const LSAView *l2);
+int lsa_match_short_view (ShortLSA *l1, const LSAView *l2);
 
 int lsa_more_recent (CompleteLSA *l1, CompleteLSA *l2);
+int lsa_more_recent_view (CompleteLSA *l1, const LSAView *l2);
 int lsa_get_age (CompleteLSA *lsa);
 int lsa_short_get_age (ShortLSA *lsa);
 
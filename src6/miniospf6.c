@@ -6,6 +6,8 @@
 #include <unistd.h>
 #include <signal.h>
 
+#include <sys/epoll.h>
+
 #include <netlink/socket.h>
 #include <netlink/msg.h>
 
@@ -32,8 +34,6 @@
 #define ALL6_OSPF_ROUTERS "ff02::5"
 #define ALL6_OSPF_DESIGNATED_ROUTERS "ff02::6"
 
-int sigterm_pipe_fds[2];
-
 NetworkWatcher *init_network_watcher (void) {
 	NetworkWatcher *watcher = NULL;
 	struct nl_sock * sock_req;
@@ -68,49 +68,73 @@ NetworkWatcher *init_network_watcher (void) {
 	return watcher;
 }
 
-static void _sigterm_handler (int signum) {
-	//fprintf (stderr, "SIGTERM SIGINT Handler\n");
-	if (sigterm_pipe_fds[1] >= 0) {
-		if (write (sigterm_pipe_fds[1], "", 1) == -1 ) {
-			//fprintf (stderr, "Write to sigterm_pipe failed.\n");
-		}
-		close (sigterm_pipe_fds[1]);
-		sigterm_pipe_fds[1] = -1;
+void process_one_packet (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFPacket *packet, int res) {
+	int type;
+	OSPFHeader header;
+	struct timespec now;
+	
+	/* Cuánto esperó el paquete desde que llegó al kernel */
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	latency_histogram_add_since (&miniospf->rx_latency, packet->rx_time, now);
+	
+	type = ospf_validate_header (packet->buffer, res, &header);
+	
+	if (type < 0) {
+		/* Paquete mal formado */
+		return;
+	}
+	
+	header.packet = packet;
+	
+	if (memcmp (&miniospf->all_ospf_designated_addr, &packet->dst.sin6_addr, sizeof (struct in6_addr)) == 0) {
+		/* Es un paquete destinado a ff02::6, ignorar, yo no soy DR o BDR */
+		return;
 	}
-}
-
-static void _main_setup_signal (void) {
-	struct sigaction act;
-	sigset_t empty_mask;
 	
-	/* Preparar el pipe para la señal de cierre */
-	if (pipe (sigterm_pipe_fds) != 0) {
-		perror ("Failed to create SIGTERM pipe");
-		sigterm_pipe_fds[0] = -1;
+	/* Si no hay enlace, no hay nada que procesar */
+	if (ospf_link == NULL) {
+		return;
 	}
 	
-	/* Instalar un manejador de señales para SIGTERM */
-	sigemptyset (&empty_mask);
-	act.sa_mask    = empty_mask;
-	act.sa_flags   = 0;
-	act.sa_handler = &_sigterm_handler;
-	if (sigaction (SIGTERM, &act, NULL) < 0) {
-		perror ("Failed to register SIGTERM handler");
+	/* Comparar que la ifndex coincida con nuestra interfaz de red,
+	 * y también que el dst local sea de nuestra interfaz */
+	if (ospf_link->iface->index != packet->src.sin6_scope_id) {
+		/* Paquete recibido en la interfaz incorrecta */
+		return;
 	}
 	
-	if (sigaction (SIGINT, &act, NULL) < 0) {
-		perror ("Failed to register SIGINT handler");
+	/* Revisar que el área coincida el área del ospf_link */
+	if (memcmp (&ospf_link->area, &header.area, sizeof (header.area)) != 0) {
+		/* Como es de un área diferente, reportar */
+		return;
+	}
+	
+	/* Ahora, procesar los paquetes por tipo */
+	switch (type) {
+		case 1: /* OSPF Hello */
+			ospf_process_hello (miniospf, ospf_link, &header);
+			break;
+		case 2: /* OSPF DD */
+			ospf_process_dd (miniospf, ospf_link, &header);
+			break;
+		case 3: /* OSPF Request */
+			ospf_process_req (miniospf, ospf_link, &header);
+			break;
+		case 4: /* OSPF Update */
+			ospf_process_update (miniospf, ospf_link, &header);
+			break;
+		case 5: /* Ack */
+			ospf_process_ack (miniospf, ospf_link, &header);
+			break;
 	}
 }
 
-void process_packet (OSPFMini *miniospf) {
-	int res;
-	OSPFPacket packet;
-	int type;
-	OSPFHeader header;
+void process_packet (OSPFMini *miniospf, OSPFLink *ospf_link, int s) {
+	int res, g;
+	OSPFPacket *packets;
 	
 	do {
-		res = socket_recv (miniospf->socket, &packet);
+		res = socket_recv_batch (s, &packets);
 		
 		if (res < 0 && errno == EAGAIN) {
 			break; /* Nada más que leer */
@@ -121,94 +145,234 @@ void process_packet (OSPFMini *miniospf) {
 			break;
 		}
 		
-		type = ospf_validate_header (packet.buffer, res, &header);
-		
-		if (type < 0) {
-			/* Paquete mal formado */
-			continue;
-		}
-		
-		header.packet = &packet;
-		
-		if (memcmp (&miniospf->all_ospf_designated_addr, &packet.dst.sin6_addr, sizeof (struct in6_addr)) == 0) {
-			/* Es un paquete destinado a ff02::6, ignorar, yo no soy DR o BDR */
-			continue;
-		}
-		
-		/* Si no hay enlace, no hay nada que procesar */
-		if (miniospf->ospf_link == NULL) {
-			continue;
+		for (g = 0; g < res; g++) {
+			process_one_packet (miniospf, ospf_link, &packets[g], packets[g].length);
 		}
 		
-		/* Comparar que la ifndex coincida con nuestra interfaz de red,
-		 * y también que el dst local sea de nuestra interfaz */
-		if (miniospf->ospf_link->iface->index != packet.src.sin6_scope_id) {
-			/* Paquete recibido en la interfaz incorrecta */
-			continue;
-		}
+		/* Un lote incompleto significa que el socket quedó vacío */
+	} while (miniospf->has_nonblocking && res == SOCKET_RECV_BATCH);
+}
+
+static void _main_netlink_cb (int fd, uint32_t events, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	
+	netlink_events_drain (miniospf->watcher);
+}
+
+static void _main_ospf_socket_cb (int fd, uint32_t events, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	
+	process_packet (miniospf, miniospf->ospf_link, fd);
+}
+
+/* Socket atado a la interfaz de un enlace, todo lo que llega es para ese enlace */
+static void _main_link_socket_cb (int fd, uint32_t events, void *arg) {
+	OSPFLink *ospf_link = (OSPFLink *) arg;
+	
+	process_packet (ospf_link->miniospf, ospf_link, fd);
+}
+
+static void _main_uring_completion (uint64_t user_data, int res, unsigned int flags, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	OSPFPacket packet;
+	
+	if (URING_TAG_KIND (user_data) == URING_KIND_NETLINK_RECV) {
+		netlink_events_uring_complete (miniospf->watcher, res, flags);
+		return;
+	}
+	
+	res = socket_uring_complete (user_data, res, flags, &packet);
+	
+	if (res > 0) {
+		process_one_packet (miniospf, miniospf->ospf_link, &packet, res);
+	} else if (res < 0 && miniospf->uring_fallen_back == 0) {
+		/* El kernel no mantiene el recvmsg multishot, volver a leer el socket con epoll, una sola vez */
+		miniospf->uring_fallen_back = 1;
+		event_loop_add_fd (&miniospf->loop, miniospf->socket, EPOLLIN | EPOLLPRI, _main_ospf_socket_cb, miniospf);
+	}
+}
+
+static void _main_uring_cb (int fd, uint32_t events, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	
+	uring_reap (&miniospf->uring, _main_uring_completion, miniospf);
+	
+	/* Entregar juntos los cambios de red que llegaron en este lote */
+	netlink_events_settle (miniospf->watcher);
+}
+
+static int _main_uring_start (OSPFMini *miniospf) {
+	if (uring_init (&miniospf->uring, 256) < 0) {
+		return -1;
+	}
+	
+	if (socket_uring_start (&miniospf->uring, miniospf->socket) < 0) {
+		uring_destroy (&miniospf->uring);
 		
-		/* Revisar que el área coincida el área del ospf_link */
-		if (memcmp (&miniospf->ospf_link->area, &header.area, sizeof (header.area)) != 0) {
-			/* Como es de un área diferente, reportar */
-			continue;
-		}
+		return -1;
+	}
+	
+	if (netlink_events_uring_start (miniospf->watcher, &miniospf->uring) < 0 ||
+	    uring_submit (&miniospf->uring, 0) < 0) {
+		netlink_events_uring_stop (miniospf->watcher);
+		socket_uring_stop ();
+		uring_destroy (&miniospf->uring);
 		
-		/* Ahora, procesar los paquetes por tipo */
-		switch (type) {
-			case 1: /* OSPF Hello */
-				ospf_process_hello (miniospf, miniospf->ospf_link, &header);
-				break;
-			case 2: /* OSPF DD */
-				ospf_process_dd (miniospf, miniospf->ospf_link, &header);
-				break;
-			case 3: /* OSPF Request */
-				ospf_process_req (miniospf, miniospf->ospf_link, &header);
-				break;
-			case 4: /* OSPF Update */
-				ospf_process_update (miniospf, miniospf->ospf_link, &header);
-				break;
-			case 5: /* Ack */
-				ospf_process_ack (miniospf, miniospf->ospf_link, &header);
-				break;
-		}
-	} while (miniospf->has_nonblocking);
+		return -1;
+	}
+	
+	miniospf->use_uring = 1;
+	
+	return 0;
 }
 
-void main_loop (OSPFMini *miniospf) {
-	struct pollfd poller[4];
-	int poller_count;
-	int has_term_pipe = 0;
-	int res, g;
-	int start;
-	struct timespec now, hello_timer, last, elapsed;
-	int big_update;
+static void _main_uring_stop (OSPFMini *miniospf) {
+	if (miniospf->use_uring == 0) return;
 	
-	memset (poller, 0, sizeof (poller));
+	/* Espera a que salgan los envíos pendientes */
+	socket_uring_stop ();
+	netlink_events_uring_stop (miniospf->watcher);
+	uring_destroy (&miniospf->uring);
 	
-	/* Agregar el socket nl de vigilancia de eventos */
-	poller[0].fd = miniospf->watcher->fd_sock_route_events;
-	poller[0].events = POLLIN | POLLPRI;
+	miniospf->use_uring = 0;
+}
+
+static void _main_packet_ring_one (unsigned char *data, unsigned int len, int ifindex, struct timespec *stamp, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	OSPFPacket packet;
+	int res;
 	
-	poller_count = 1;
+	res = socket_ring_packet (data, len, ifindex, stamp, &packet);
 	
-	if (sigterm_pipe_fds[0] != -1) {
-		has_term_pipe = 1;
-		
-		poller[1].fd = sigterm_pipe_fds[0];
-		poller[1].events = POLLIN | POLLPRI;
+	if (res > 0) {
+		process_one_packet (miniospf, miniospf->ospf_link, &packet, res);
+	}
+}
+
+static void _main_packet_ring_cb (int fd, uint32_t events, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	
+	packet_ring_drain (&miniospf->packet_ring, _main_packet_ring_one, miniospf);
+}
+
+static int _main_packet_ring_start (OSPFMini *miniospf) {
+	if (packet_ring_init (&miniospf->packet_ring, ETH_P_IPV6, miniospf->config.packet_ring_size, miniospf->config.packet_ring_timeout) < 0) {
+		return -1;
+	}
+	
+	if (socket_ring_start (&miniospf->packet_ring, miniospf->socket) < 0) {
+		socket_ring_stop ();
+		packet_ring_destroy (&miniospf->packet_ring);
 		
-		poller_count++;
+		return -1;
 	}
 	
-	/* Agregar los fd por el socket ospf */
-	poller[poller_count].fd = miniospf->socket;
-	poller[poller_count].events = POLLIN | POLLPRI;
+	miniospf->use_packet_ring = 1;
+	
+	return 0;
+}
+
+static void _main_packet_ring_stop (OSPFMini *miniospf) {
+	if (miniospf->use_packet_ring == 0) return;
 	
-	poller_count++;
+	socket_ring_stop ();
+	packet_ring_destroy (&miniospf->packet_ring);
 	
-	clock_gettime (CLOCK_MONOTONIC, &now);
-	last = hello_timer = now;
-	ospf_send_hello (miniospf);
+	miniospf->use_packet_ring = 0;
+}
+
+static void _main_sigterm_cb (int signum, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	
+	/* Señal de cierre */
+	event_loop_quit (&miniospf->loop);
+}
+
+static void _main_stats_cb (int signum, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	unsigned long received, sent;
+	
+	printf ("LSA recibidos: %lu aceptados, %lu duplicados, %lu más viejos, %lu descartados por MinLSArrival\n",
+	        miniospf->lsa_arrivals.accepted, miniospf->lsa_arrivals.duplicates, miniospf->lsa_arrivals.older, miniospf->lsa_arrivals.dropped);
+	printf ("Sockets OSPF: %lu paquetes descartados por el kernel (buffer de recepción lleno)\n", socket_rx_drops ());
+	if (miniospf->use_uring) {
+		socket_uring_counters (&received, &sent);
+		printf ("io_uring: %lu paquetes recibidos, %lu enviados, %lu llamadas a io_uring_enter (%.3f por paquete)\n",
+		        received, sent, miniospf->uring.enters, received + sent > 0 ? (double) miniospf->uring.enters / (received + sent) : 0.0);
+	}
+	if (miniospf->use_packet_ring) {
+		printf ("Anillo AF_PACKET: %lu paquetes en %lu bloques, %lu descartados por el kernel (anillo lleno)\n",
+		        miniospf->packet_ring.packets, miniospf->packet_ring.blocks, packet_ring_drops (&miniospf->packet_ring));
+	}
+	latency_histogram_print (&miniospf->rx_latency, stdout, "Espera entre la llegada al kernel y el procesamiento");
+	fflush (stdout);
+}
+
+static void _main_send_retry_cb (void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	
+	/* Reintentar lo que el kernel no aceptó, mientras siga quedando algo en la cola */
+	if (socket_flush () > 0) {
+		timers_add_msec (&miniospf->timers, &miniospf->send_retry_timer, SOCKET_SEND_RETRY);
+	}
+}
+
+static void _main_iteration_cb (void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	int g, big_update;
+	
+	/* Los LSA pudieron cambiar con los eventos de red o los paquetes, reprogramar su renovación */
+	lsa_schedule_refresh (miniospf);
+	
+	big_update = 0;
+	for (g = 0; miniospf->ospf_link != NULL && g < miniospf->n_lsas; g++) {
+		if (miniospf->lsas[g].need_update) {
+			big_update = 1;
+			break;
+		}
+	}
+	
+	/* Si tenemos enlace y algún cambio en nuestro LSA */
+	if (big_update) {
+		ospf_send_update (miniospf);
+	}
+	
+	/* Todo lo encolado en esta vuelta se entrega con una sola llamada */
+	if (miniospf->use_uring) {
+		uring_submit (&miniospf->uring, 0);
+	}
+	
+	if (socket_flush () > 0 && !timers_is_pending (&miniospf->send_retry_timer)) {
+		/* El socket está lleno, reintentar lo que quedó en la cola un poco después */
+		timers_add_msec (&miniospf->timers, &miniospf->send_retry_timer, SOCKET_SEND_RETRY);
+	}
+}
+
+void main_loop (OSPFMini *miniospf) {
+	int g;
+	
+	if (miniospf->config.use_uring && _main_uring_start (miniospf) < 0) {
+		fprintf (stderr, "io_uring no disponible, usando epoll\n");
+	}
+	
+	if (miniospf->use_uring) {
+		/* Los sockets se leen con io_uring, epoll solo vigila sus terminaciones */
+		event_loop_add_fd (&miniospf->loop, miniospf->uring.fd, EPOLLIN, _main_uring_cb, miniospf);
+	} else {
+		/* Agregar el socket nl de vigilancia de eventos y el socket ospf */
+		event_loop_add_fd (&miniospf->loop, miniospf->watcher->fd_sock_route_events, EPOLLIN | EPOLLPRI, _main_netlink_cb, miniospf);
+		
+		/* Con el anillo, el socket raw solo envía. Con sockets por enlace, cada enlace registra el suyo */
+		if (miniospf->use_packet_ring == 0 && miniospf->config.socket_per_link == 0) {
+			event_loop_add_fd (&miniospf->loop, miniospf->socket, EPOLLIN | EPOLLPRI, _main_ospf_socket_cb, miniospf);
+		}
+	}
+	
+	if (miniospf->use_packet_ring) {
+		event_loop_add_fd (&miniospf->loop, miniospf->packet_ring.fd, EPOLLIN, _main_packet_ring_cb, miniospf);
+	}
+	
+	event_loop_set_iteration_func (&miniospf->loop, _main_iteration_cb, miniospf);
 	
 	/* Instalar los eventos de la red */
 	netlink_events_interface_added_func (miniospf->watcher, (InterfaceCB) ospf_change_interface_add);
@@ -217,97 +381,24 @@ void main_loop (OSPFMini *miniospf) {
 	netlink_events_ip_address_deleted_func (miniospf->watcher, (IPAddressCB) ospf_change_address_delete);
 	netlink_events_interface_up_func (miniospf->watcher, (InterfaceCB) ospf_change_interface_up);
 	netlink_events_interface_down_func (miniospf->watcher, (InterfaceCB) ospf_change_interface_down);
+	netlink_events_changes_settled_func (miniospf->watcher, (NetworkChangesCB) ospf_change_settled);
 	netlink_events_ip_address_arg (miniospf->watcher, miniospf);
 	
-	do {
-		res = poll (poller, poller_count, 50);
-		
-		if (res < 0 && errno != EINTR) {
-			break;
-		}
-		
-		if (poller[0].revents != 0) {
-			nl_recvmsgs_default (miniospf->watcher->nl_sock_route_events);
-			
-			poller[0].revents = 0;
-		}
-		
-		/* Si después de procesar los eventos de red,
-		 * nuestra interfaz de red activa despareció,
-		 * cerrar el loop */
-		
-		start = 1;
-		if (has_term_pipe) {
-			start = 2;
-			if (poller[1].revents != 0) {
-				/* Señal de cierre */
-				break;
-			}
-		}
-		
-		/* Revisar el socket aquí */
-		if (poller[start].revents != 0) {
-			
-			process_packet (miniospf);
-			poller[start].revents = 0;
-		}
-		
-		if (miniospf->ospf_link == NULL) continue; /* No tenemos enlace */
-		
-		/* En caso de no haber eventos, revisar el tiempo */
-		clock_gettime (CLOCK_MONOTONIC, &now);
-		
-		elapsed = timespec_diff (hello_timer, now);
-		
-		if (elapsed.tv_sec >= miniospf->ospf_link->hello_interval) {
-			if (miniospf->ospf_link->state >= OSPF_ISM_Waiting) {
-				/* La interfaz está activa, enviar hellos */
-				ospf_send_hello (miniospf);
-			}
-			hello_timer = now;
-		}
-		
-		if (miniospf->ospf_link->state == OSPF_ISM_Waiting) {
-			elapsed = timespec_diff (miniospf->ospf_link->waiting_time, now);
-			
-			if (elapsed.tv_sec >= miniospf->ospf_link->dead_router_interval) {
-				/* Timeout para waiting. Tiempo de elegir un router */
-				ospf_dr_election (miniospf, miniospf->ospf_link);
-			}
-		}
-		/* Recorrer cada uno de los vecinos y eliminarlos basados en el dead router interval */
-		ospf_check_neighbors (miniospf, now);
-		
-		for (g = 0; g < miniospf->n_lsas; g++) {
-			/* Revisar si nuestro LSA ha envejecido mas de treinta minutos para renovarlo */
-			if (LSA_AGE (&miniospf->lsas[g]) > OSPF_LSA_REFRESH_TIME) {
-				if (miniospf->lsas[g].type != LSA_INTRA_AREA_PREFIX || (miniospf->lsas[g].type == LSA_INTRA_AREA_PREFIX && miniospf->lsas[g].intra_area_prefix.n_prefixes > 0)) {
-					lsa_refresh_lsa (&miniospf->lsas[g], miniospf->lsas[g].seq_num);
-				}
-			}
-		}
-		
-		big_update = 0;
-		for (g = 0; g < miniospf->n_lsas; g++) {
-			if (miniospf->lsas[g].need_update) {
-				big_update = 1;
-				break;
-			}
-		}
-		
-		/* Si tenemos algún cambio en nuestro LSA */
-		if (big_update) {
-			ospf_send_update (miniospf);
-		}
-	} while (1);
+	event_loop_run (&miniospf->loop);
 	
-	/* Envejecer prematuramente mi LSA para provocar que se elimine pronto */
+	/* Envejecer prematuramente mi LSA para provocar que se elimine pronto,
+	 * sin esperar al throttle */
+	timers_cancel (&miniospf->timers, &miniospf->lsa_throttle_timer);
 	for (g = 0; g < miniospf->n_lsas; g++) {
 		lsa_expire_lsa (&miniospf->lsas[g]);
 		miniospf->lsas[g].need_update = 1;
 	}
 	
 	ospf_send_update (miniospf);
+	
+	socket_flush ();
+	_main_uring_stop (miniospf);
+	_main_packet_ring_stop (miniospf);
 }
 
 void print_usage (FILE* stream, int exit_code, const char *program_name) {
@@ -323,6 +414,30 @@ void print_usage (FILE* stream, int exit_code, const char *program_name) {
 		"  -r  --router-id router_id           Specify IP address as Router ID.\n"
 		"  -e  --hello interval                Use 'interval' seconds for sending hellos.\n"
 		"  -d  --router-dead interval          Use 'interval' seconds as Router Dead Interval.\n"
+		"  -j  --jitter percent                Randomize up to 'percent' of each hello and\n"
+		"                                      retransmit interval (default 10, 0 disables).\n"
+		"  -l  --lsa-throttle init,hold,max    Delay in milliseconds before originating a changed\n"
+		"                                      LSA, hold time doubled on bursts up to max\n"
+		"                                      (default 50,200,5000).\n"
+		"  -x  --retransmit initial,max        Retransmit interval in milliseconds for DD, LS\n"
+		"                                      requests and updates, doubled on each retry up\n"
+		"                                      to max (default 5000,40000).\n"
+		"  -m  --hello-multiplier count        Use a Router Dead Interval of 1 second and send\n"
+		"                                      'count' hellos per second (3-20).\n"
+		"  -b  --socket-buffers rcv,snd        Kernel receive and send buffer sizes in bytes for\n"
+		"                                      the OSPF socket, 0 keeps the system default\n"
+		"                                      (default 1048576,262144).\n"
+		"  -q  --qos dscp,priority             DSCP for outgoing OSPF packets and local socket\n"
+		"                                      priority, -1 keeps the system default\n"
+		"                                      (default 48,7: CS6 and TC_PRIO_CONTROL).\n"
+		"  -u  --io-uring                      Use io_uring for the OSPF and netlink sockets\n"
+		"                                      (Linux 6.0+, falls back to epoll).\n"
+		"  -k  --packet-ring size_kib,msec     Receive OSPF packets from an AF_PACKET TPACKET_V3\n"
+		"                                      ring of 'size_kib' KiB, blocks handed over after\n"
+		"                                      'msec' milliseconds (falls back to the raw socket).\n"
+		"                                      Up to 262144 KiB and 10000 msec.\n"
+		"  -s  --socket-per-interface          Open a raw socket for each OSPF interface, bound\n"
+		"                                      with SO_BINDTODEVICE (not with -u or -k).\n"
 		"  -a  --area area_id                  Area ID for active interface.\n"
 		"  -t  --area-type {standard | stub | nssa}   Config area type.\n"
 		"  -c  --cost value                    Interface cost.\n"
@@ -335,10 +450,11 @@ void _parse_cmd_line_args (OSPFConfig *config, int argc, char **argv) {
 	int next_option;
 	const char *program_name = argv[0];
 	struct in_addr ip;
-	int ret, value;
+	int ret, value, value2;
+	long initial, hold, max;
 	int option_index;
 	
-	const char* const short_options = "hi:p:r:e:a:t:d:c:";
+	const char* const short_options = "hi:p:r:e:a:t:d:c:m:j:l:x:b:q:uk:s";
 	const struct option long_options[] = {
 		{ "help", 0, NULL, 'h' },
 		{ "active-interface", 1, NULL, 'i' },
@@ -346,6 +462,15 @@ void _parse_cmd_line_args (OSPFConfig *config, int argc, char **argv) {
 		{ "router-id", 1, NULL, 'r' },
 		{ "hello", 1, NULL, 'e' },
 		{ "router-dead", 1, NULL, 'd' },
+		{ "hello-multiplier", 1, NULL, 'm' },
+		{ "jitter", 1, NULL, 'j' },
+		{ "lsa-throttle", 1, NULL, 'l' },
+		{ "retransmit", 1, NULL, 'x' },
+		{ "socket-buffers", 1, NULL, 'b' },
+		{ "qos", 1, NULL, 'q' },
+		{ "io-uring", 0, NULL, 'u' },
+		{ "packet-ring", 1, NULL, 'k' },
+		{ "socket-per-interface", 0, NULL, 's' },
 		{ "area", 1, NULL, 'a' },
 		{ "area-type", 1, NULL, 't' },
 		{ "cost", 1, NULL, 'c' },
@@ -415,7 +540,8 @@ void _parse_cmd_line_args (OSPFConfig *config, int argc, char **argv) {
 			case 'e':
 				ret = sscanf (optarg, "%d", &value);
 				
-				if (ret > 0) {
+				/* El intervalo viaja en 16 bits dentro del hello */
+				if (ret > 0 && value >= 1 && value <= 65535) {
 					config->hello_interval = value;
 				} else {
 					print_usage (stderr, 1, program_name);
@@ -424,12 +550,90 @@ void _parse_cmd_line_args (OSPFConfig *config, int argc, char **argv) {
 			case 'd':
 				ret = sscanf (optarg, "%d", &value);
 				
-				if (ret > 0) {
+				/* En OSPFv3 el Router Dead Interval también es de 16 bits */
+				if (ret > 0 && value > 0 && value <= 65535) {
 					config->dead_router_interval = value;
 				} else {
 					print_usage (stderr, 1, program_name);
 				}
 				break;
+			case 'm':
+				ret = sscanf (optarg, "%d", &value);
+				
+				if (ret > 0 && value >= 3 && value <= 20) {
+					config->hello_multiplier = value;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 'j':
+				ret = sscanf (optarg, "%d", &value);
+				
+				if (ret > 0 && value >= 0 && value <= 50) {
+					config->jitter_percent = value;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 'l':
+				ret = sscanf (optarg, "%ld,%ld,%ld", &initial, &hold, &max);
+				
+				if (ret == 3 && initial >= 0 && hold > 0 && max >= hold) {
+					config->lsa_throttle_initial = initial;
+					config->lsa_throttle_hold = hold;
+					config->lsa_throttle_max = max;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 'x':
+				ret = sscanf (optarg, "%ld,%ld", &initial, &max);
+				
+				if (ret == 2 && initial > 0 && max >= initial) {
+					config->rxmt_interval_msec = initial;
+					config->rxmt_max_msec = max;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 'b':
+				ret = sscanf (optarg, "%d,%d", &value, &value2);
+				
+				if (ret == 2 && value >= 0 && value2 >= 0) {
+					config->socket_rcvbuf = value;
+					config->socket_sndbuf = value2;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 'q':
+				ret = sscanf (optarg, "%d,%d", &value, &value2);
+				
+				if (ret == 2 && value >= -1 && value < 64 && value2 >= -1) {
+					config->socket_dscp = value;
+					config->socket_priority = value2;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 'u':
+				config->use_uring = 1;
+				break;
+			case 'k':
+				ret = sscanf (optarg, "%d,%d", &value, &value2);
+				
+				/* Acotar antes de multiplicar, value * 1024 no debe desbordar */
+				if (ret == 2 && value > 0 && value <= PACKET_RING_MAX_SIZE_KIB && value2 > 0 && value2 <= PACKET_RING_MAX_TIMEOUT) {
+					config->use_packet_ring = 1;
+					config->packet_ring_size = value * 1024;
+					config->packet_ring_timeout = value2;
+				} else {
+					print_usage (stderr, 1, program_name);
+				}
+				break;
+			case 's':
+				config->socket_per_link = 1;
+				break;
 			case 'c':
 				ret = sscanf (optarg, "%d", &value);
 				
@@ -447,6 +651,12 @@ void _parse_cmd_line_args (OSPFConfig *config, int argc, char **argv) {
 		}
 	} while (next_option != -1);
 	
+	/* Con --hello-multiplier los intervalos no se usan */
+	if (config->hello_multiplier == 0 && config->dead_router_interval <= config->hello_interval) {
+		fprintf (stderr, "The Router Dead Interval must be greater than the hello interval\n");
+		print_usage (stderr, 1, program_name);
+	}
+	
 	/* Crear las opciones que serán compartidas por la mayoría de los paquetes */
 	config->options_a = config->options_b = config->options_c = 0;
 	config->options_c = 0x11; /* Bit R, bit V6 */
@@ -528,9 +738,27 @@ int main (int argc, char *argv[]) {
 	miniospf.config.hello_interval = 10;
 	miniospf.config.dead_router_interval = 40;
 	miniospf.config.cost = 10;
+	miniospf.config.jitter_percent = 10;
+	miniospf.config.rxmt_interval_msec = 5000;
+	miniospf.config.rxmt_max_msec = 40000;
+	miniospf.config.socket_rcvbuf = 1048576;
+	miniospf.config.socket_sndbuf = 262144;
+	miniospf.config.socket_dscp = 48;
+	miniospf.config.socket_priority = 7;
+	miniospf.config.packet_ring_size = 262144;
+	miniospf.config.packet_ring_timeout = 10;
+	miniospf.config.lsa_throttle_initial = 50;
+	miniospf.config.lsa_throttle_hold = 200;
+	miniospf.config.lsa_throttle_max = 5000;
 	
 	_parse_cmd_line_args (&miniospf.config, argc, argv);
 	
+	/* io_uring y el anillo leen solo el socket compartido */
+	if (miniospf.config.socket_per_link && (miniospf.config.use_uring || miniospf.config.use_packet_ring)) {
+		fprintf (stderr, "--socket-per-interface can't be used with --io-uring or --packet-ring, ignoring\n");
+		miniospf.config.socket_per_link = 0;
+	}
+	
 	memset (&router_id_zero, 0, sizeof (router_id_zero));
 	if (miniospf.config.active_interface_name[0] == 0) {
 		/* No hay interfaz activa, cerrar */
@@ -558,10 +786,16 @@ int main (int argc, char *argv[]) {
 		}
 	}
 	
-	/* Activar el manejador de la señal */
-	sigterm_pipe_fds[0] = sigterm_pipe_fds[1] = -1;
+	/* Preparar el loop de eventos y el manejador de las señales */
+	if (event_loop_init (&miniospf.loop, &miniospf.timers) < 0) {
+		fprintf (stderr, "Could not create the event loop\n");
+		
+		return 1;
+	}
 	
-	_main_setup_signal ();
+	event_loop_add_signal (&miniospf.loop, SIGTERM, _main_sigterm_cb, &miniospf);
+	event_loop_add_signal (&miniospf.loop, SIGINT, _main_sigterm_cb, &miniospf);
+	event_loop_add_signal (&miniospf.loop, SIGUSR1, _main_stats_cb, &miniospf);
 	
 	/* Preparar las IP's 224.0.0.5 y 224.0.0.6 */
 	memset (&miniospf.all_ospf_routers_addr, 0, sizeof (miniospf.all_ospf_routers_addr));
@@ -605,10 +839,34 @@ int main (int argc, char *argv[]) {
 	/* Revisar si tiene activado el no-bloqueante */
 	miniospf.has_nonblocking = socket_non_blocking (miniospf.socket);
 	
+	socket_set_buffers (miniospf.socket, miniospf.config.socket_rcvbuf, miniospf.config.socket_sndbuf);
+	socket_set_priority (miniospf.socket, miniospf.config.socket_dscp, miniospf.config.socket_priority);
+	
+	/* El anillo debe existir antes del enlace, que le instala su filtro */
+	if (miniospf.config.use_packet_ring && _main_packet_ring_start (&miniospf) < 0) {
+		fprintf (stderr, "AF_PACKET TPACKET_V3 no disponible, usando el socket raw\n");
+	}
+	
 	miniospf.dummy_iface = pasiva;
 	
+	/* Preparar la cola de timers */
+	timers_queue_init (&miniospf.timers);
+	lsa_arrival_init (&miniospf.lsa_arrivals, OSPF_MIN_LS_ARRIVAL);
+	latency_histogram_init (&miniospf.rx_latency);
+	timers_init (&miniospf.lsa_refresh_timer, lsa_refresh_timer_cb, &miniospf);
+	timers_init (&miniospf.send_retry_timer, _main_send_retry_cb, &miniospf);
+	
 	lsa_populate_init (&miniospf);
 	
+	/* Semilla para el jitter, distinta entre routers y entre reinicios */
+	srandom (miniospf.config.router_id ^ getpid () ^ time (NULL));
+	
+	if (miniospf.config.socket_per_link) {
+		/* El socket compartido no recibe nada, cada enlace abre el suyo */
+		socket_set_filter (miniospf.socket, NULL);
+		miniospf.link_socket_cb = _main_link_socket_cb;
+	}
+	
 	/* Crear la interfaz ospf de datos */
 	miniospf.ospf_link = ospf_create_iface (&miniospf, iface_activa);
 	if (miniospf.ospf_link == NULL) {
@@ -25,7 +25,7 @@ void ospf_change_interface_delete (Interface *iface, void *arg) {
 	if (iface == miniospf->dummy_iface) {
 		/* La interfaz dummy desaparece. Actualizar el Inter Area Prefix LSA */
 		miniospf->dummy_iface = NULL;
-		lsa_update_intra_area_prefix (miniospf);
+		miniospf->lsa_dirty |= LSA_DIRTY_INTRA_AREA_PREFIX;
 	} else if (miniospf->ospf_link != NULL) {
 		if (iface == miniospf->ospf_link->iface) {
 			/* Esto es un problema. Sin la interfaz principal activa, no hay loop principal */
@@ -33,7 +33,7 @@ void ospf_change_interface_delete (Interface *iface, void *arg) {
 			
 			miniospf->ospf_link = NULL;
 			
-			lsa_update_link_local (miniospf);
+			miniospf->lsa_dirty |= LSA_DIRTY_LINK;
 		}
 	}
 }
@@ -44,14 +44,8 @@ void ospf_change_address_delete (Interface *iface, IPAddr *addr, void *arg) {
 	
 	if (addr->family != AF_INET6) return;
 	
-	if (iface == miniospf->dummy_iface) {
-		/* La interfaz dummy pierde una IP, actualizar el Router LSA */
-		/* Ignorar si la IP eliminada es una de enlace local */
-		if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) return;
-		
-		/* De otra forma, actualizar el Intra Area Prefix */
-		lsa_update_intra_area_prefix (miniospf);
-	} else if (miniospf->ospf_link != NULL) {
+	/* Las IP de la interfaz dummy se revisan al final del lote en ospf_change_settled */
+	if (iface != miniospf->dummy_iface && miniospf->ospf_link != NULL) {
 		/* Esto *podría* ser un problema.
 		 * Si la dirección principal es eliminada, y no hay otras IP
 		 * no hay forma de comunicación con los otros routers */
@@ -62,13 +56,8 @@ void ospf_change_address_delete (Interface *iface, IPAddr *addr, void *arg) {
 			
 			/* Si la interfaz *tuviera* otra ip de enlace local, intentar recrear el enlace con otra IP */
 			miniospf->ospf_link = ospf_create_iface (miniospf, iface);
-			lsa_update_link_local (miniospf);
-		} else {
-			/* Caso contrario, se eliminó otra IP, actualizar el link local LSA */
-			if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) return;
-			
-			lsa_update_link_local (miniospf);
-		}
+			miniospf->lsa_dirty |= LSA_DIRTY_LINK;
+		} /* Caso contrario, se eliminó otra IP, se revisa en ospf_change_settled */
 	}
 }
 
@@ -79,25 +68,44 @@ void ospf_change_address_add (Interface *iface, IPAddr *addr, void *arg) {
 	
 	memset (&addr_zero, 0, sizeof (addr_zero));
 	
-	if (iface == miniospf->dummy_iface) {
-		/* Si la interfaz dummy gana una IP de enlace local, ignorar */
-		if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) return;
-		
-		/* De otra forma, actualizar el Intra Area Prefix */
-		lsa_update_intra_area_prefix (miniospf);
-	} else if (miniospf->ospf_link == NULL) {
+	/* Las IP de la interfaz dummy se revisan al final del lote en ospf_change_settled */
+	if (iface != miniospf->dummy_iface && miniospf->ospf_link == NULL) {
 		if (!IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) return;
 		/* Si no tenemos ospf_link, y agregaron una IP y es enlace local,
 		 * intentar recrear el enlace */
 		if (strcmp (iface->name, miniospf->config.active_interface_name) == 0) {
 			miniospf->ospf_link = ospf_create_iface (miniospf, iface);
-			lsa_update_link_local (miniospf);
+			miniospf->lsa_dirty |= LSA_DIRTY_LINK;
 		}
-	} else if (miniospf->ospf_link->iface == iface) {
-		if (IN6_IS_ADDR_LINKLOCAL (&addr->sin6_addr)) return;
+	} /* Las IP globales del enlace activo se revisan en ospf_change_settled */
+}
+
+/* Se llama una vez que se leyeron todos los eventos de red pendientes.
+ * Los manejadores individuales solo hacen el trabajo estructural del enlace,
+ * aquí se decide qué LSA cambiaron, una sola vez por lote */
+void ospf_change_settled (GList *changes, void *arg) {
+	OSPFMini *miniospf = (OSPFMini *) arg;
+	NetworkChange *change;
+	GList *g;
+	
+	for (g = changes; g != NULL; g = g->next) {
+		change = (NetworkChange *) g->data;
+		
+		if (change->type != NETWORK_CHANGE_ADDRESS_ADDED && change->type != NETWORK_CHANGE_ADDRESS_DELETED) continue;
+		if (change->addr.family != AF_INET6) continue;
 		
-		lsa_update_link_local (miniospf);
+		/* Las IP de enlace local no se anuncian */
+		if (IN6_IS_ADDR_LINKLOCAL (&change->addr.sin6_addr)) continue;
+		
+		if (miniospf->dummy_iface != NULL && change->ifindex == miniospf->dummy_iface->index) {
+			miniospf->lsa_dirty |= LSA_DIRTY_INTRA_AREA_PREFIX;
+		} else if (miniospf->ospf_link != NULL && change->ifindex == miniospf->ospf_link->iface->index) {
+			miniospf->lsa_dirty |= LSA_DIRTY_LINK;
+		}
 	}
+	
+	/* Una sola generación para todos los cambios de este lote */
+	lsa_schedule_update (miniospf, 0);
 }
 
 void ospf_change_interface_up (Interface *iface, void *arg) {
@@ -113,7 +121,9 @@ void ospf_change_interface_up (Interface *iface, void *arg) {
 			miniospf->ospf_link->state = OSPF_ISM_Waiting;
 			miniospf->ospf_link->waiting_time = now;
 			
-			ospf_send_hello (miniospf);
+			timers_add_msec (&miniospf->timers, &miniospf->ospf_link->wait_timer, miniospf->ospf_link->dead_interval_msec);
+			
+			ospf_trigger_hello (miniospf, miniospf->ospf_link);
 		}
 	}
 }
@@ -138,6 +148,7 @@ void ospf_change_interface_down (Interface *iface, void *arg) {
 			}
 			
 			miniospf->ospf_link->state = OSPF_ISM_Down;
+			timers_cancel (&miniospf->timers, &miniospf->ospf_link->wait_timer);
 		}
 	}
 }
@@ -9,5 +9,6 @@ void ospf_change_address_delete (Interface *iface, IPAddr *addr, void *arg);
 void ospf_change_address_add (Interface *iface, IPAddr *addr, void *arg);
 void ospf_change_interface_down (Interface *iface, void *arg);
 void ospf_change_interface_up (Interface *iface, void *arg);
+void ospf_change_settled (GList *changes, void *arg);
 
 #endif
@@ -7,6 +7,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <time.h>
@@ -22,7 +23,301 @@
 static int ospf_db_desc_is_dup (OSPFDD *dd, OSPFNeighbor *vecino);
 void ospf_resend_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino);
 void ospf_neighbor_add_update (OSPFNeighbor *vecino, CompleteLSA *lsa);
-void ospf_neighbor_remove_update (OSPFNeighbor *vecino, ShortLSA *ss);
+void ospf_neighbor_remove_update (OSPFNeighbor *vecino, const LSAView *ack);
+void ospf_resend_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino);
+
+/* Siguiente retransmisión de un vecino: RxmtInterval la primera vez,
+ * y el doble en cada reintento hasta el máximo de la interfaz */
+static long _ospf_rxmt_delay (OSPFNeighbor *vecino, long *current) {
+	OSPFLink *ospf_link = vecino->ospf_link;
+	
+	if (*current <= 0) {
+		*current = ospf_link->rxmt_interval_msec;
+	}
+	
+	return timers_jitter (*current, ospf_link->miniospf->config.jitter_percent);
+}
+
+static void _ospf_rxmt_backoff (OSPFNeighbor *vecino, long *current) {
+	OSPFLink *ospf_link = vecino->ospf_link;
+	
+	if (*current <= 0) return;
+	
+	*current = *current * 2;
+	if (*current > ospf_link->rxmt_max_msec) *current = ospf_link->rxmt_max_msec;
+}
+
+static void _ospf_hello_timer_cb (void *arg) {
+	OSPFLink *ospf_link = (OSPFLink *) arg;
+	OSPFMini *miniospf = ospf_link->miniospf;
+	
+	if (ospf_link->state >= OSPF_ISM_Waiting) {
+		/* La interfaz está activa, enviar hellos */
+		ospf_send_hello (miniospf);
+	}
+	
+	timers_add_msec (&miniospf->timers, &ospf_link->hello_timer, timers_jitter (ospf_link->hello_interval_msec, miniospf->config.jitter_percent));
+}
+
+static void _ospf_triggered_hello_cb (void *arg) {
+	OSPFLink *ospf_link = (OSPFLink *) arg;
+	OSPFMini *miniospf = ospf_link->miniospf;
+	
+	if (ospf_link->state < OSPF_ISM_Waiting) return;
+	
+	ospf_send_hello (miniospf);
+	throttle_fired (&ospf_link->hello_throttle);
+	
+	/* Acabamos de enviar un hello, el periódico puede esperar un intervalo completo */
+	timers_add_msec (&miniospf->timers, &ospf_link->hello_timer, timers_jitter (ospf_link->hello_interval_msec, miniospf->config.jitter_percent));
+}
+
+/* Adelantar el siguiente hello, para que el vecino nos vea sin esperar al hello interval.
+ * Los disparos seguidos se limitan con el throttle del enlace */
+void ospf_trigger_hello (OSPFMini *miniospf, OSPFLink *ospf_link) {
+	if (ospf_link->state < OSPF_ISM_Waiting) return;
+	
+	if (timers_is_pending (&ospf_link->triggered_hello_timer)) {
+		/* Ya hay un hello adelantado en camino */
+		return;
+	}
+	
+	timers_add_msec (&miniospf->timers, &ospf_link->triggered_hello_timer, throttle_next_delay (&ospf_link->hello_throttle));
+}
+
+static void _ospf_wait_timer_cb (void *arg) {
+	OSPFLink *ospf_link = (OSPFLink *) arg;
+	
+	if (ospf_link->state == OSPF_ISM_Waiting) {
+		/* Timeout para waiting. Tiempo de elegir un router */
+		ospf_dr_election (ospf_link->miniospf, ospf_link);
+	}
+}
+
+static void _ospf_inactivity_timer_cb (void *arg) {
+	OSPFNeighbor *vecino = (OSPFNeighbor *) arg;
+	OSPFLink *ospf_link = vecino->ospf_link;
+	
+	/* Timeout para este vecino, matarlo y correr las elecciones otra vez */
+	ospf_del_neighbor (ospf_link, vecino);
+	
+	ospf_dr_election (ospf_link->miniospf, ospf_link);
+}
+
+static void _ospf_dd_timer_cb (void *arg) {
+	OSPFNeighbor *vecino = (OSPFNeighbor *) arg;
+	OSPFLink *ospf_link = vecino->ospf_link;
+	
+	/* Revisar si estamos en EX_START o EXCHANGE con master, para reenviar el DD */
+	if (vecino->way == EX_START || (vecino->way == EXCHANGE && IS_SET_DD_MS (vecino->dd_flags))) {
+		_ospf_rxmt_backoff (vecino, &vecino->dd_rxmt_msec);
+		ospf_resend_dd (ospf_link->miniospf, ospf_link, vecino);
+	}
+}
+
+static void _ospf_request_timer_cb (void *arg) {
+	OSPFNeighbor *vecino = (OSPFNeighbor *) arg;
+	OSPFLink *ospf_link = vecino->ospf_link;
+	
+	/* Si estamos estado EXCHANGE o LOADING, y no he recibido el update correspondiente a mi request, reenviar mi request */
+	if (vecino->requests_pending > 0 && (vecino->way == EXCHANGE || vecino->way == LOADING)) {
+		_ospf_rxmt_backoff (vecino, &vecino->request_rxmt_msec);
+		ospf_send_req (ospf_link->miniospf, ospf_link, vecino);
+	}
+}
+
+static void _ospf_update_timer_cb (void *arg) {
+	OSPFNeighbor *vecino = (OSPFNeighbor *) arg;
+	OSPFLink *ospf_link = vecino->ospf_link;
+	
+	/* Si estamos en FULL, y tenemos un update pendiente, reenviar el update */
+	if (vecino->updates != NULL && vecino->way == FULL) {
+		_ospf_rxmt_backoff (vecino, &vecino->update_rxmt_msec);
+		ospf_resend_update (ospf_link->miniospf, ospf_link, vecino);
+	}
+}
+
+/* Arma el hello completo del enlace en un paquete del pool, que se envía por referencia */
+static OSPFPacket *_ospf_hello_build (OSPFMini *miniospf, OSPFLink *ospf_link) {
+	GList *g;
+	OSPFPacket *packet;
+	size_t pos;
+	uint16_t hello_interval = htons (ospf_link->hello_interval);
+	uint16_t dead_interval = htons (ospf_link->dead_router_interval);
+	OSPFNeighbor *vecino;
+	uint32_t v32;
+	
+	packet = socket_packet_new ();
+	
+	if (packet == NULL) return NULL;
+	
+	ospf_fill_header (1, packet->buffer, miniospf->config.router_id, ospf_link->area, miniospf->config.instance_id);
+	pos = 16;
+	
+	v32 = htonl (ospf_link->iface->index);
+	memcpy (&packet->buffer[pos], &v32, sizeof (uint32_t));
+	pos = pos + 4;
+	
+	/* La prioridad */
+	packet->buffer[pos] = 0; /* Router priority */
+	pos++;
+	
+#if 0
+	/* FIXME: Revisar las opciones de IPv6 */
+	if (ospf_link->area_type == OSPF_AREA_STANDARD) {
+		packet->buffer[pos++] = 0x02; /* External Routing */
+	} else if (ospf_link->area_type == OSPF_AREA_STUB) {
+		packet->buffer[pos++] = 0x00;
+	} else if (ospf_link->area_type == OSPF_AREA_NSSA) {
+		packet->buffer[pos++] = 0x08;
+	}
+#endif
+	packet->buffer[pos++] = 0;
+	packet->buffer[pos++] = 0;
+	packet->buffer[pos++] = 0x13;
+	
+	memcpy (&packet->buffer[pos], &hello_interval, sizeof (hello_interval));
+	pos = pos + 2;
+	
+	memcpy (&packet->buffer[pos], &dead_interval, sizeof (dead_interval));
+	pos = pos + 2;
+	
+	memcpy (&packet->buffer[pos], &ospf_link->designated, sizeof (uint32_t));
+	pos = pos + 4;
+	
+	memcpy (&packet->buffer[pos], &ospf_link->backup, sizeof (uint32_t));
+	pos = pos + 4;
+	
+	g = ospf_link->neighbors;
+	while (g != NULL && pos + 4 <= sizeof (packet->buffer)) {
+		vecino = (OSPFNeighbor *) g->data;
+		
+		/* Agregar al vecino para que me reconozca */
+		memcpy (&packet->buffer[pos], &vecino->router_id, sizeof (uint32_t));
+		pos = pos + 4;
+		
+		g = g->next;
+	}
+	
+	ospf_fill_header_end (packet->buffer, pos);
+	packet->length = pos;
+	
+	/* Armar la información de packet info */
+	packet->dst.sin6_family = AF_INET6;
+	packet->dst.sin6_scope_id = ospf_link->iface->index;
+	memcpy (&packet->dst.sin6_addr, &miniospf->all_ospf_routers_addr, sizeof (struct in6_addr));
+	
+	packet->src.sin6_family = AF_INET6;
+	memcpy (&packet->src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
+	
+	return packet;
+}
+
+/* Reemplaza "n" bytes del hello en "pos". El checksum lo calcula el kernel al enviar */
+static void _ospf_hello_patch (OSPFPacket *hello, size_t pos, const void *data, size_t n) {
+	memcpy (&hello->buffer[pos], data, n);
+}
+
+static void _ospf_hello_set_length (OSPFPacket *hello, uint16_t len) {
+	uint16_t v;
+	
+	v = htons (len);
+	_ospf_hello_patch (hello, 2, &v, sizeof (v));
+	hello->length = len;
+}
+
+/* El hello puede seguir en la cola de envío, parchar una copia propia */
+static OSPFPacket *_ospf_hello_writable (OSPFLink *ospf_link) {
+	OSPFPacket *hello;
+	
+	if (ospf_link->hello == NULL) return NULL;
+	
+	hello = socket_packet_unshare (ospf_link->hello);
+	
+	if (hello == NULL) {
+		/* Sin memoria para la copia, armarlo completo en el siguiente envío */
+		socket_packet_unref (ospf_link->hello);
+	}
+	
+	ospf_link->hello = hello;
+	
+	return hello;
+}
+
+/* Agrega (old_id en NULL), cambia o quita (new_id en NULL) el router id de un vecino en el hello.
+ * Al quitarlo, el último vecino de la lista ocupa su lugar */
+static void _ospf_hello_update_neighbor (OSPFLink *ospf_link, uint32_t *old_id, uint32_t *new_id) {
+	OSPFPacket *hello;
+	uint32_t last;
+	size_t pos;
+	
+	hello = _ospf_hello_writable (ospf_link);
+	
+	if (hello == NULL) return;
+	
+	if (old_id == NULL) {
+		pos = hello->length;
+		
+		if (pos + 4 > sizeof (hello->buffer)) return;
+		
+		_ospf_hello_set_length (hello, pos + 4);
+		_ospf_hello_patch (hello, pos, new_id, sizeof (uint32_t));
+		
+		return;
+	}
+	
+	for (pos = OSPF_HELLO_NEIGHBORS_POS; pos + 4 <= hello->length; pos += 4) {
+		if (memcmp (&hello->buffer[pos], old_id, sizeof (uint32_t)) == 0) break;
+	}
+	
+	if (pos + 4 > hello->length) return;
+	
+	if (new_id != NULL) {
+		_ospf_hello_patch (hello, pos, new_id, sizeof (uint32_t));
+		
+		return;
+	}
+	
+	memcpy (&last, &hello->buffer[hello->length - 4], sizeof (uint32_t));
+	_ospf_hello_patch (hello, pos, &last, sizeof (uint32_t));
+	_ospf_hello_set_length (hello, hello->length - 4);
+}
+
+static void _ospf_hello_update_dr (OSPFLink *ospf_link) {
+	OSPFPacket *hello;
+	uint32_t dr_bdr[2];
+	
+	hello = _ospf_hello_writable (ospf_link);
+	
+	if (hello == NULL) return;
+	
+	memcpy (&dr_bdr[0], &ospf_link->designated, sizeof (uint32_t));
+	memcpy (&dr_bdr[1], &ospf_link->backup, sizeof (uint32_t));
+	_ospf_hello_patch (hello, OSPF_HELLO_DR_POS, dr_bdr, sizeof (dr_bdr));
+}
+
+/* Socket raw propio del enlace, con las mismas opciones que el compartido */
+static int _ospf_link_open_socket (OSPFMini *miniospf, Interface *iface) {
+	int s;
+	
+	s = socket_create ();
+	
+	if (s < 0) {
+		return -1;
+	}
+	
+	if (socket_bind_device (s, iface->name) < 0) {
+		close (s);
+		
+		return -1;
+	}
+	
+	socket_non_blocking (s);
+	socket_set_buffers (s, miniospf->config.socket_rcvbuf, miniospf->config.socket_sndbuf);
+	socket_set_priority (s, miniospf->config.socket_dscp, miniospf->config.socket_priority);
+	
+	return s;
+}
 
 OSPFLink *ospf_create_iface (OSPFMini *miniospf, Interface *iface) {
 	IPAddr *link_local_addr, *addr;
@@ -30,6 +325,7 @@ OSPFLink *ospf_create_iface (OSPFMini *miniospf, Interface *iface) {
 	struct ipv6_mreq mcast_req;
 	struct timespec now;
 	GList *g;
+	long hold;
 	
 	link_local_addr = NULL;
 	/* Localizar la dirección IP de enlace local FE80 */
@@ -52,27 +348,58 @@ OSPFLink *ospf_create_iface (OSPFMini *miniospf, Interface *iface) {
 		return NULL;
 	}
 	
+	ospf_link->miniospf = miniospf;
 	ospf_link->iface = iface;
 	ospf_link->link_local_addr = link_local_addr;
 	
+	ospf_link->socket = miniospf->socket;
+	ospf_link->socket_watch = NULL;
+	
+	if (miniospf->config.socket_per_link) {
+		ospf_link->socket = _ospf_link_open_socket (miniospf, iface);
+		
+		if (ospf_link->socket < 0) {
+			free (ospf_link);
+			
+			return NULL;
+		}
+	}
+	
 	/* Asociar al grupo multicast FF02::5 de esta interfaz */
 	memset (&mcast_req, 0, sizeof (mcast_req));
 	memcpy (&mcast_req.ipv6mr_multiaddr, &miniospf->all_ospf_routers_addr, sizeof (struct in6_addr));
 	mcast_req.ipv6mr_interface = iface->index;
 	
-	if (setsockopt (miniospf->socket, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &mcast_req, sizeof (mcast_req)) < 0) {
+	if (setsockopt (ospf_link->socket, IPPROTO_IPV6, IPV6_ADD_MEMBERSHIP, &mcast_req, sizeof (mcast_req)) < 0) {
 		perror ("Error executing IPv6 ADD_MEMBERSHIP Multicast");
+		if (ospf_link->socket != miniospf->socket) {
+			close (ospf_link->socket);
+		}
 		free (ospf_link);
 		
 		return NULL;
 	}
 	
-	ospf_link->hello_interval = miniospf->config.hello_interval;
-	ospf_link->dead_router_interval = miniospf->config.dead_router_interval;
+	if (miniospf->config.hello_multiplier > 0) {
+		/* Modo fast-hello: el hello interval viaja en 0 y el dead interval en 1 segundo */
+		ospf_link->hello_interval = 0;
+		ospf_link->dead_router_interval = 1;
+		ospf_link->hello_interval_msec = 1000 / miniospf->config.hello_multiplier;
+		ospf_link->dead_interval_msec = 1000;
+	} else {
+		ospf_link->hello_interval = miniospf->config.hello_interval;
+		ospf_link->dead_router_interval = miniospf->config.dead_router_interval;
+		ospf_link->hello_interval_msec = ospf_link->hello_interval * 1000L;
+		ospf_link->dead_interval_msec = ospf_link->dead_router_interval * 1000L;
+	}
+	
+	ospf_link->rxmt_interval_msec = miniospf->config.rxmt_interval_msec;
+	ospf_link->rxmt_max_msec = miniospf->config.rxmt_max_msec;
 	
 	ospf_link->neighbors = NULL;
 	memset (&ospf_link->designated, 0, sizeof (ospf_link->designated));
 	memset (&ospf_link->backup, 0, sizeof (ospf_link->backup));
+	ospf_link->hello = NULL;
 	
 	memcpy (&ospf_link->area, &miniospf->config.area_id, sizeof (uint32_t));
 	ospf_link->area_type = miniospf->config.area_type;
@@ -89,11 +416,37 @@ OSPFLink *ospf_create_iface (OSPFMini *miniospf, Interface *iface) {
 	
 	ospf_link->state = OSPF_ISM_Down;
 	
+	timers_init (&ospf_link->hello_timer, _ospf_hello_timer_cb, ospf_link);
+	timers_init (&ospf_link->wait_timer, _ospf_wait_timer_cb, ospf_link);
+	timers_init (&ospf_link->triggered_hello_timer, _ospf_triggered_hello_cb, ospf_link);
+	
+	hold = OSPF_TRIGGERED_HELLO_HOLD;
+	if (hold > ospf_link->hello_interval_msec) hold = ospf_link->hello_interval_msec;
+	throttle_init (&ospf_link->hello_throttle, OSPF_TRIGGERED_HELLO_DELAY, hold, ospf_link->hello_interval_msec);
+	
+	/* Solo dejar pasar en el kernel lo que es para este enlace */
+	socket_set_filter (ospf_link->socket, ospf_link);
+	
+	/* El socket propio se lee directo para este enlace */
+	if (ospf_link->socket != miniospf->socket && miniospf->link_socket_cb != NULL) {
+		ospf_link->socket_watch = event_loop_add_fd (&miniospf->loop, ospf_link->socket, EPOLLIN | EPOLLPRI, miniospf->link_socket_cb, ospf_link);
+	}
+	
 	if (iface->flags & IFF_UP) {
 		/* La interfaz está activa, enviar hellos */
 		clock_gettime (CLOCK_MONOTONIC, &now);
 		ospf_link->state = OSPF_ISM_Waiting;
 		ospf_link->waiting_time = now;
+		
+		timers_add_msec (&miniospf->timers, &ospf_link->wait_timer, ospf_link->dead_interval_msec);
+	}
+	
+	/* Desfasar el primer hello de cada interfaz dentro del intervalo,
+	 * para que los routers que arrancan juntos no queden sincronizados */
+	if (miniospf->config.jitter_percent > 0) {
+		timers_add_msec (&miniospf->timers, &ospf_link->hello_timer, random () % ospf_link->hello_interval_msec);
+	} else {
+		timers_add_msec (&miniospf->timers, &ospf_link->hello_timer, 0);
 	}
 	
 	return ospf_link;
@@ -109,10 +462,14 @@ void ospf_destroy_link (OSPFMini *miniospf, OSPFLink *ospf_link) {
 	memcpy (&mcast_req.ipv6mr_multiaddr, &miniospf->all_ospf_routers_addr, sizeof (struct in6_addr));
 	mcast_req.ipv6mr_interface = ospf_link->iface->index;
 	
-	if (setsockopt (miniospf->socket, IPPROTO_IPV6, IPV6_DROP_MEMBERSHIP, &mcast_req, sizeof (mcast_req)) < 0) {
+	if (setsockopt (ospf_link->socket, IPPROTO_IPV6, IPV6_DROP_MEMBERSHIP, &mcast_req, sizeof (mcast_req)) < 0) {
 		perror ("Error executing IPv6 DROP_MEMBERSHIP Multicast");
 	}
 	
+	/* Sin hello, los vecinos se quitan sin parcharlo */
+	socket_packet_unref (ospf_link->hello);
+	ospf_link->hello = NULL;
+	
 	/* Destruir la lista de vecinos */
 	g = ospf_link->neighbors;
 	while (g != NULL) {
@@ -122,6 +479,18 @@ void ospf_destroy_link (OSPFMini *miniospf, OSPFLink *ospf_link) {
 		ospf_del_neighbor (ospf_link, vecino);
 	}
 	
+	timers_cancel (&miniospf->timers, &ospf_link->hello_timer);
+	timers_cancel (&miniospf->timers, &ospf_link->wait_timer);
+	timers_cancel (&miniospf->timers, &ospf_link->triggered_hello_timer);
+	
+	if (ospf_link->socket != miniospf->socket) {
+		event_loop_remove_fd (&miniospf->loop, ospf_link->socket_watch);
+		socket_close (ospf_link->socket);
+	} else {
+		/* Sin enlace no hay nada que procesar */
+		socket_set_filter (miniospf->socket, NULL);
+	}
+	
 	free (ospf_link);
 }
 
@@ -177,9 +546,20 @@ OSPFNeighbor * ospf_add_neighbor (OSPFLink *ospf_link, OSPFHeader *header, OSPFH
 	vecino->requests_pending = 0;
 	vecino->updates = NULL;
 	vecino->interface_id = hello->interface_id;
+	vecino->ospf_link = ospf_link;
+	
+	timers_init (&vecino->inactivity_timer, _ospf_inactivity_timer_cb, vecino);
+	timers_init (&vecino->dd_timer, _ospf_dd_timer_cb, vecino);
+	timers_init (&vecino->request_timer, _ospf_request_timer_cb, vecino);
+	timers_init (&vecino->update_timer, _ospf_update_timer_cb, vecino);
+	vecino->dd_rxmt_msec = 0;
+	vecino->request_rxmt_msec = 0;
+	vecino->update_rxmt_msec = 0;
+	vecino->dd_last_sent = NULL;
 	
 	/* Agregar a la lista ligada */
 	ospf_link->neighbors = g_list_append (ospf_link->neighbors, vecino);
+	_ospf_hello_update_neighbor (ospf_link, NULL, &vecino->router_id);
 	
 	return vecino;
 }
@@ -214,16 +594,16 @@ void ospf_neighbor_add_update (OSPFNeighbor *vecino, CompleteLSA *lsa) {
 	vecino->updates = g_list_append (vecino->updates, other);
 }
 
-void ospf_neighbor_remove_update (OSPFNeighbor *vecino, ShortLSA *ss) {
+void ospf_neighbor_remove_update (OSPFNeighbor *vecino, const LSAView *ack) {
 	GList *g;
 	ShortLSA *other;
 	
 	for (g = vecino->updates; g != NULL; g = g->next) {
 		other = (ShortLSA *) g->data;
 		
-		if (lsa_match_short_short (ss, other) == 0) {
+		if (lsa_match_short_view (other, ack) == 0) {
 			/* Revisar el que el SEQ sea el que nosotros queremos */
-			if (ss->seq_num == other->seq_num) {
+			if (lsa_view_seq_num (ack) == other->seq_num) {
 				/* Eliminar el nodo de la lista de pendientes */
 				vecino->updates = g_list_delete_link (vecino->updates, g);
 				
@@ -236,11 +616,21 @@ void ospf_neighbor_remove_update (OSPFNeighbor *vecino, ShortLSA *ss) {
 }
 
 void ospf_del_neighbor (OSPFLink *ospf_link, OSPFNeighbor *vecino) {
+	TimerQueue *timers = &ospf_link->miniospf->timers;
+	
+	timers_cancel (timers, &vecino->inactivity_timer);
+	timers_cancel (timers, &vecino->dd_timer);
+	timers_cancel (timers, &vecino->request_timer);
+	timers_cancel (timers, &vecino->update_timer);
+	
 	g_list_free_full (vecino->updates, (GDestroyNotify) free);
 	
-	free (vecino);
+	socket_packet_unref (vecino->dd_last_sent);
 	
 	ospf_link->neighbors = g_list_remove (ospf_link->neighbors, vecino);
+	_ospf_hello_update_neighbor (ospf_link, &vecino->router_id, NULL);
+	
+	free (vecino);
 }
 
 void ospf_neighbor_state_change (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino, int state) {
@@ -250,6 +640,15 @@ void ospf_neighbor_state_change (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNe
 	
 	vecino->way = state;
 	
+	/* Cancelar las retransmisiones que ya no aplican en el nuevo estado */
+	if (state != EX_START && state != EXCHANGE) {
+		timers_cancel (&miniospf->timers, &vecino->dd_timer);
+	}
+	
+	if (state != EXCHANGE && state != LOADING) {
+		timers_cancel (&miniospf->timers, &vecino->request_timer);
+	}
+	
 	if (state == EX_START) {
 		if (vecino->dd_seq == 0) {
 			vecino->dd_seq = (unsigned int) time (NULL);
@@ -268,10 +667,13 @@ void ospf_neighbor_state_change (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNe
 	} else if (state < FULL && old_state == FULL) {
 		/* Eliminar las actualizaciones pendientes, ya no sirve que las reenvie */
 		g_list_free_full (vecino->updates, (GDestroyNotify) free);
+		vecino->updates = NULL;
+		
+		timers_cancel (&miniospf->timers, &vecino->update_timer);
 	} else if (state == FULL) {
 		if (vecino->router_id == ospf_link->designated) {
 			/* Cambié a FULL con el designated */
-			lsa_update_router_lsa (miniospf);
+			lsa_schedule_update (miniospf, LSA_DIRTY_ROUTER);
 		}
 	}
 }
@@ -445,16 +847,21 @@ void ospf_dr_election (OSPFMini *miniospf, OSPFLink *ospf_link) {
 	//}
 	
 	ospf_link->state = OSPF_ISM_DROther;
+	timers_cancel (&miniospf->timers, &ospf_link->wait_timer);
 	
 	g_list_free (elegibles);
 	
 	if (memcmp (&old_bdr, &ospf_link->backup, sizeof (uint32_t)) != 0 ||
 	    memcmp (&old_dr, &ospf_link->designated, sizeof (uint32_t)) != 0) {
 		ospf_check_adj (miniospf, ospf_link);
+		
+		/* Anunciar el nuevo DR/BDR sin esperar al siguiente hello */
+		_ospf_hello_update_dr (ospf_link);
+		ospf_trigger_hello (miniospf, ospf_link);
 	}
 	
 	if (memcmp (&old_dr, &ospf_link->designated, sizeof (uint32_t)) != 0) {
-		lsa_update_router_lsa (miniospf);
+		lsa_schedule_update (miniospf, LSA_DIRTY_ROUTER);
 	}
 }
 
@@ -477,8 +884,8 @@ void ospf_process_hello (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *he
 	OSPFNeighbor *vecino;
 	uint32_t empty;
 	int found;
-	struct timespec now;
 	int neighbor_change;
+	int nuevo;
 	
 	hello = (OSPFHello *) header->buffer;
 	
@@ -508,8 +915,10 @@ void ospf_process_hello (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *he
 	
 	vecino = ospf_locate_neighbor (ospf_link, header->router_id);
 	
+	nuevo = 0;
 	if (vecino == NULL) {
 		vecino = ospf_add_neighbor (ospf_link, header, hello);
+		nuevo = 1;
 	} else {
 		/* Actualizar los datos del vecino */
 		memcpy (&vecino->designated, &hello->designated, sizeof (uint32_t));
@@ -528,8 +937,20 @@ void ospf_process_hello (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *he
 		}
 	}
 	
-	clock_gettime (CLOCK_MONOTONIC, &now);
-	vecino->last_seen = now;
+	if (nuevo || found == 0) {
+		/* El vecino necesita vernos en un hello para pasar a 2-Way, no esperar al intervalo */
+		ospf_trigger_hello (miniospf, ospf_link);
+	}
+	
+	/* El vecino se vio cuando el kernel recibió el hello, no cuando lo procesamos.
+	 * Así un hello que esperó en la cola no alarga la vida del vecino */
+	if (nuevo || timespec_cmp (header->packet->rx_time, vecino->last_seen) > 0) {
+		/* Nunca hacia atrás: un hello más viejo que el último visto no acorta la vida del vecino */
+		vecino->last_seen = header->packet->rx_time;
+	}
+	
+	/* Reiniciar el timer de inactividad de este vecino */
+	timers_add_deadline (&miniospf->timers, &vecino->inactivity_timer, timespec_add_msec (vecino->last_seen, ospf_link->dead_interval_msec));
 	
 	neighbor_change = 0;
 	if (vecino->way == ONE_WAY && found == 1) {
@@ -559,12 +980,24 @@ void ospf_process_hello (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *he
 	}
 }
 
+static void _ospf_neighbor_schedule_dd_rxmt (OSPFMini *miniospf, OSPFNeighbor *vecino) {
+	/* Solo retransmitimos el DD en EX_START o si somos el maestro en EXCHANGE */
+	if (vecino->way == EX_START || (vecino->way == EXCHANGE && IS_SET_DD_MS (vecino->dd_flags))) {
+		timers_add_msec (&miniospf->timers, &vecino->dd_timer, _ospf_rxmt_delay (vecino, &vecino->dd_rxmt_msec));
+	} else {
+		timers_cancel (&miniospf->timers, &vecino->dd_timer);
+	}
+}
+
 void ospf_resend_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino) {
 	int res;
 	
+	if (vecino->dd_last_sent == NULL) return;
+	
 	printf ("Reenviando OSPF DD\n");
 	
-	res = socket_send (miniospf->socket, &vecino->dd_last_sent);
+	/* El mismo buffer del último DD, sin copiarlo */
+	res = socket_send_ref (ospf_link->socket, vecino->dd_last_sent);
 	
 	if (res < 0) {
 		perror ("Sendto");
@@ -572,74 +1005,82 @@ void ospf_resend_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *veci
 	
 	/* Marcar el timestamp de la última vez que envié el DD */
 	clock_gettime (CLOCK_MONOTONIC, &vecino->dd_last_sent_time);
+	
+	_ospf_neighbor_schedule_dd_rxmt (miniospf, vecino);
 }
 
 void ospf_send_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino) {
-	OSPFPacket packet;
+	OSPFPacket *packet;
 	size_t pos, pos_flags;
 	uint16_t t16;
 	uint32_t t32;
 	int g;
 	
-	ospf_fill_header (2, packet.buffer, miniospf->config.router_id, ospf_link->area, miniospf->config.instance_id);
+	packet = socket_packet_new ();
+	
+	if (packet == NULL) {
+		return;
+	}
+	
+	ospf_fill_header (2, packet->buffer, miniospf->config.router_id, ospf_link->area, miniospf->config.instance_id);
 	pos = 16;
 	
-	packet.buffer[pos++] = 0; /* Reservado */
+	packet->buffer[pos++] = 0; /* Reservado */
 
 #if 0
 	// FIXME: Revisar esto de las opciones
 	if (ospf_link->area_type == OSPF_AREA_STANDARD) {
-		packet.buffer[pos++] = 0x02; /* External Routing */
+		packet->buffer[pos++] = 0x02; /* External Routing */
 	} else if (ospf_link->area_type == OSPF_AREA_STUB) {
-		packet.buffer[pos++] = 0x00; /* Las áreas stub no tienen external routing */
+		packet->buffer[pos++] = 0x00; /* Las áreas stub no tienen external routing */
 	} else if (ospf_link->area_type == OSPF_AREA_NSSA) {
-		packet.buffer[pos++] = 0x08; /* Las áreas nssa no tienen external pero tienen nssa bit */
+		packet->buffer[pos++] = 0x08; /* Las áreas nssa no tienen external pero tienen nssa bit */
 	}
 #endif
-	packet.buffer[pos++] = 0;
-	packet.buffer[pos++] = 0;
-	packet.buffer[pos++] = 0x13;
+	packet->buffer[pos++] = 0;
+	packet->buffer[pos++] = 0;
+	packet->buffer[pos++] = 0x13;
 	
 	t16 = htons (ospf_link->iface->mtu);
-	memcpy (&packet.buffer[pos], &t16, sizeof (uint16_t));
+	memcpy (&packet->buffer[pos], &t16, sizeof (uint16_t));
 	pos = pos + 2;
 	
-	packet.buffer[pos++] = 0; /* Reservado */
+	packet->buffer[pos++] = 0; /* Reservado */
 	
 	pos_flags = pos;
-	packet.buffer[pos++] = vecino->dd_flags;
+	packet->buffer[pos++] = vecino->dd_flags;
 	
 	t32 = htonl (vecino->dd_seq);
-	memcpy (&packet.buffer[pos], &t32, sizeof (uint32_t));
+	memcpy (&packet->buffer[pos], &t32, sizeof (uint32_t));
 	pos = pos + 4;
 	
 	/* Enviar nuestro único Router LSA si no ha sido enviado ya */
 	if (!IS_SET_DD_I (vecino->dd_flags) && vecino->dd_sent == 0) {
 		vecino->dd_flags &= ~(OSPF_DD_FLAG_M); /* Desactivar la bandera de More */
-		packet.buffer[pos_flags] = vecino->dd_flags;
+		packet->buffer[pos_flags] = vecino->dd_flags;
 		
 		for (g = 0; g < miniospf->n_lsas; g++) {
-			lsa_write_lsa_header (&packet.buffer[pos], &miniospf->lsas[g]);
+			lsa_write_image_header (&packet->buffer[pos], &miniospf->lsas[g]);
 			pos = pos + 20;
 		}
 		
 		vecino->dd_sent = 1;
 	}
 	
-	ospf_fill_header_end (packet.buffer, pos);
-	packet.length = pos;
+	ospf_fill_header_end (packet->buffer, pos);
+	packet->length = pos;
 	
 	int res;
 	
 	/* Armar la información de packet info */
-	packet.dst.sin6_family = AF_INET6;
-	packet.dst.sin6_scope_id = ospf_link->iface->index;
-	memcpy (&packet.dst.sin6_addr, &vecino->neigh_addr, sizeof (struct in6_addr));
+	packet->dst.sin6_family = AF_INET6;
+	packet->dst.sin6_scope_id = ospf_link->iface->index;
+	memcpy (&packet->dst.sin6_addr, &vecino->neigh_addr, sizeof (struct in6_addr));
 	
-	packet.src.sin6_family = AF_INET6;
-	memcpy (&packet.src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
+	packet->src.sin6_family = AF_INET6;
+	memcpy (&packet->src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
 	
-	res = socket_send (miniospf->socket, &packet);
+	res = socket_send_ref (ospf_link->socket, packet);
 	
 	if (res < 0) {
 		perror ("Sendto");
@@ -648,7 +1089,13 @@ void ospf_send_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino
 	/* Marcar el timestamp de la última vez que envié el DD */
 	clock_gettime (CLOCK_MONOTONIC, &vecino->dd_last_sent_time);
 	
-	memcpy (&vecino->dd_last_sent, &packet, sizeof (packet));
+	/* El vecino se queda con nuestra referencia, para las retransmisiones */
+	socket_packet_unref (vecino->dd_last_sent);
+	vecino->dd_last_sent = packet;
+	
+	/* DD nuevo, la retransmisión vuelve a empezar en RxmtInterval */
+	vecino->dd_rxmt_msec = 0;
+	_ospf_neighbor_schedule_dd_rxmt (miniospf, vecino);
 }
 
 void ospf_send_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino) {
@@ -697,20 +1144,22 @@ void ospf_send_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecin
 	packet.src.sin6_family = AF_INET6;
 	memcpy (&packet.src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
 	
-	res = socket_send (miniospf->socket, &packet);
+	res = socket_send (ospf_link->socket, &packet);
 	
 	if (res < 0) {
 		perror ("Sendto");
 	}
 	
 	clock_gettime (CLOCK_MONOTONIC, &vecino->request_last_sent_time);
+	
+	timers_add_msec (&miniospf->timers, &vecino->request_timer, _ospf_rxmt_delay (vecino, &vecino->request_rxmt_msec));
 }
 
-void ospf_add_request (OSPFNeighbor *vecino, ShortLSA *update) {
+void ospf_add_request (OSPFNeighbor *vecino, const LSAView *update) {
 	int g;
 	ReqLSA req;
 	
-	lsa_create_request_from_short (update, &req);
+	lsa_create_request_from_view (update, &req);
 	
 	/* Si este LSA que se quiere agregar, ya está en nuestra lista de peticiones, no agregar */
 	for (g = 0; g < vecino->requests_pending; g++) {
@@ -730,26 +1179,19 @@ void ospf_add_request (OSPFNeighbor *vecino, ShortLSA *update) {
 
 void ospf_db_desc_proc (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header, OSPFNeighbor *vecino, OSPFDD *dd) {
 	int g, h;
-	CompleteLSA lsa;
-	ShortLSA *update;
+	LSAView update;
 	
 	/* Recorrer cada lsa extra en este dd, y agregar a una lista de requests */
 	for (g = 0; g < dd->n_lsas; g++) {
-		update = &dd->lsas[g];
-		update->age = ntohs (update->age);
-		update->seq_num = ntohl (update->seq_num);
-		update->length = ntohs (update->length);
-		update->link_state_id = ntohl (update->link_state_id);
-		update->type = ntohs (update->type);
+		if (lsa_view_init (&update, dd->lsas, dd->n_lsas * 20, g * 20) < 0) break;
 		
-		lsa_create_complete_from_short (update, &lsa);
 		/* Comparar contra mis LSA */
 		for (h = 0; h < miniospf->n_lsas; h++) {
-			if (lsa_match (&miniospf->lsas[h], &lsa) == 0) {
-				switch (lsa_more_recent (&miniospf->lsas[h], &lsa)) {
+			if (lsa_match_view (&miniospf->lsas[h], &update) == 0) {
+				switch (lsa_more_recent_view (&miniospf->lsas[h], &update)) {
 					case -1:
 						/* Me interesa, es mio */
-						ospf_add_request (vecino, update);
+						ospf_add_request (vecino, &update);
 						break;
 				}
 			}
@@ -817,7 +1259,7 @@ void ospf_process_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *heade
 	dd.dd_seq = ntohl (dd.dd_seq);
 	
 	dd.n_lsas = (header->len - 24 - 12) / 20; // 24 de la cabecera + 8 del Database Description
-	dd.lsas = (ShortLSA *) &header->buffer[12];
+	dd.lsas = &header->buffer[12];
 	
 	vecino = ospf_locate_neighbor (ospf_link, header->router_id);
 	
@@ -826,6 +1268,17 @@ void ospf_process_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *heade
 		return;
 	}
 	
+	/* RFC 2328 10.6: si el vecino ya envía DD es porque nos vio en nuestro hello,
+	 * pasar a 2-Way con este paquete, sin esperar a su siguiente hello */
+	if (vecino->way == ONE_WAY) {
+		ospf_neighbor_state_change (miniospf, ospf_link, vecino, TWO_WAY);
+		
+		if (ospf_link->state == OSPF_ISM_DROther) {
+			ospf_dr_election (miniospf, ospf_link);
+			ospf_check_adj (miniospf, ospf_link);
+		}
+	}
+	
 	/* Revisar si este paquete tiene el master, y ver quién debe ser el master */
 	switch (vecino->way) {
 		case EX_START:
@@ -914,9 +1367,9 @@ void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *head
 	ReqLSA req;
 	OSPFNeighbor *vecino;
 	OSPFPacket packet;
-	size_t pos, pos_lsa_update_count;
-	int len, lsa_len;
-	char buffer_lsa[4096];
+	size_t pos, pos_lsa_update_count, total;
+	int len;
+	struct iovec segments[SOCKET_SEND_SEGMENTS];
 	int lsa_count;
 	uint32_t t32;
 	int res;
@@ -952,7 +1405,9 @@ void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *head
 	
 	pos_lsa_update_count = pos;
 	pos += 4;
+	packet.length = pos;
 	lsa_count = 0;
+	total = pos;
 	
 	len = header->len - 16; /* Tamaño de la cabecera de OSPF */
 	
@@ -965,29 +1420,29 @@ void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *head
 			/* Buscar que el LSA que pida, lo tenga */
 			if (lsa_match_req_complete (&miniospf->lsas[g], &req) == 0) {
 				/* Piden alguno de mis LSAs */
-				lsa_len = lsa_write_lsa (buffer_lsa, &miniospf->lsas[g]);
+				lsa_image_set_age (&miniospf->lsas[g]);
 				
-				if (pos + lsa_len >= 1500) { /* TODO: Revisar este MTU desde la interfaz */
+				if (total + miniospf->lsas[g].image_len >= 1500 || lsa_count == SOCKET_SEND_SEGMENTS) { /* TODO: Revisar este MTU desde la interfaz */
 					/* Enviar este paquete ya, */
 					t32 = htonl (lsa_count);
 					memcpy (&packet.buffer[pos_lsa_update_count], &t32, sizeof (uint32_t));
 					
-					ospf_fill_header_end (packet.buffer, pos);
-					packet.length = pos;
+					ospf_fill_header_end_segments (packet.buffer, pos, segments, lsa_count);
 					
-					res = socket_send (miniospf->socket, &packet);
+					res = socket_sendv (ospf_link->socket, &packet, segments, lsa_count);
 		
 					if (res < 0) {
 						perror ("Sendto");
 					}
 					
 					lsa_count = 0;
-					pos = pos_lsa_update_count + 4;
+					total = pos;
 				}
 				
-				/* Copiar mi LSA */
-				memcpy (&packet.buffer[pos], buffer_lsa, lsa_len);
-				pos = pos + lsa_len;
+				/* Agregar mi LSA, apuntando a su imagen */
+				segments[lsa_count].iov_base = miniospf->lsas[g].image;
+				segments[lsa_count].iov_len = miniospf->lsas[g].image_len;
+				total = total + miniospf->lsas[g].image_len;
 				lsa_count++;
 				break;
 			}
@@ -1006,10 +1461,9 @@ void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *head
 	t32 = htonl (lsa_count);
 	memcpy (&packet.buffer[pos_lsa_update_count], &t32, sizeof (uint32_t));
 	
-	ospf_fill_header_end (packet.buffer, pos);
-	packet.length = pos;
+	ospf_fill_header_end_segments (packet.buffer, pos, segments, lsa_count);
 	
-	res = socket_send (miniospf->socket, &packet);
+	res = socket_sendv (ospf_link->socket, &packet, segments, lsa_count);
 
 	if (res < 0) {
 		perror ("Sendto");
@@ -1017,9 +1471,8 @@ void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *head
 }
 
 void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header) {
-	ShortLSA *update;
+	LSAView update;
 	ReqLSA req;
-	CompleteLSA lsa;
 	OSPFNeighbor *vecino;
 	OSPFPacket packet;
 	size_t pos;
@@ -1028,6 +1481,7 @@ void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *h
 	int res, g, h;
 	GList *pos_req;
 	int ack_count;
+	int lsa_len;
 	
 	vecino = ospf_locate_neighbor (ospf_link, header->router_id);
 	
@@ -1050,24 +1504,39 @@ void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *h
 	ack_count = 0;
 	
 	for (g = 0, len = 4; g < lsa_count; g++) {
-		update = (ShortLSA *) &header->buffer[len];
-		update->age = ntohs (update->age);
-		update->seq_num = ntohl (update->seq_num);
-		update->length = ntohs (update->length);
-		update->type = ntohs (update->type);
-		update->link_state_id = ntohl (update->link_state_id);
+		/* La cabecera del LSA, y luego el LSA completo, deben caber en el paquete */
+		if (lsa_view_init (&update, header->buffer, header->len - 16, len) < 0) {
+			break;
+		}
+		
+		lsa_len = lsa_view_length (&update);
+		if (lsa_len < 20 || len + lsa_len > header->len - 16) {
+			break;
+		}
+		
+		/* El checksum cubre todo el LSA excepto la edad. Un LSA dañado se descarta sin ACK */
+		if (!fletcher_checksum_valid (&header->buffer[len + 2], lsa_len - 2)) {
+			len += lsa_len;
+			continue;
+		}
+		
+		/* MinLSArrival: una instancia nueva que llega muy pronto después de la anterior
+		 * se descarta sin ACK, el vecino la retransmitirá */
+		if (lsa_arrival_check (&miniospf->lsa_arrivals, lsa_view_type (&update), lsa_view_link_state_id (&update), lsa_view_advert_router (&update), lsa_view_seq_num (&update)) == LSA_ARRIVAL_TOO_SOON) {
+			len += lsa_len;
+			continue;
+		}
 		
-		lsa_create_complete_from_short (update, &lsa);
 		/* Revisar el UPDATE, si es algo que nosotros pedimos previamente, quitar de la lista de peticiones y no enviar ACK */
 		for (h = 0; h < miniospf->n_lsas; h++) {
-			if (lsa_match_short_complete (&miniospf->lsas[h], update) == 0) {
-				switch (lsa_more_recent (&miniospf->lsas[h], &lsa)) {
+			if (lsa_match_view (&miniospf->lsas[h], &update) == 0) {
+				switch (lsa_more_recent_view (&miniospf->lsas[h], &update)) {
 					case -1:
-						/* El vecino tiene un LSA mas reciente, actualizar nuestra base de datos y reenviar nuestro LSA para "imponernos" */
-						lsa_refresh_lsa (&miniospf->lsas[h], lsa.seq_num);
-						if (ospf_has_full_dr (miniospf)) {
-							miniospf->lsas[h].need_update = 1;
-						}
+						/* El vecino tiene un LSA mas reciente, reenviar nuestro LSA con un número de secuencia mayor para "imponernos".
+						 * La nueva instancia sale a través del throttle, sin ciclos de originar/inundar.
+						 * Hasta entonces seguimos anunciando la instancia que corresponde a nuestra imagen */
+						lsa_set_peer_seq_num (&miniospf->lsas[h], lsa_view_seq_num (&update));
+						lsa_schedule_update (miniospf, lsa_dirty_for_type (lsa_view_type (&update)));
 						break;
 				}
 			}
@@ -1075,7 +1544,7 @@ void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *h
 		
 		if (vecino->requests_pending > 0) {
 			/* Si el update es respuesta a uno de nuestros request, quitar de la lista y no mandar ACK */
-			lsa_create_request_from_short (update, &req);
+			lsa_create_request_from_view (&update, &req);
 			for (h = 0; h < vecino->requests_pending; h++) {
 				if (lsa_request_match (&req, &vecino->requests[h]) == 0) {
 					break; /* Encontrado */
@@ -1090,22 +1559,29 @@ void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *h
 					memcpy (&vecino->requests[h], &vecino->requests[vecino->requests_pending - 1], sizeof (ReqLSA));
 				}
 				vecino->requests_pending--;
-					
+				
+				/* El vecino respondió, la siguiente retransmisión vuelve a RxmtInterval */
+				vecino->request_rxmt_msec = 0;
+				
+				if (vecino->requests_pending == 0) {
+					timers_cancel (&miniospf->timers, &vecino->request_timer);
+				}
+				
 				/* Si ya no hay mas requests, y estamos en LOADING, pasar a FULL */
 				if (vecino->way == LOADING && vecino->requests_pending == 0) {
 					ospf_neighbor_state_change (miniospf, ospf_link, vecino, FULL);
 				}
 				
 				/* Para brincar al siguiente UPDATE */
-				len += lsa.length;
+				len += lsa_len;
 				continue;
 			}
 		}
 		
-		lsa_write_lsa_header (&packet.buffer[pos], &lsa);
+		lsa_view_write_header (&packet.buffer[pos], &update);
 		pos += 20;
 		
-		len += lsa.length;
+		len += lsa_len;
 		ack_count++;
 	}
 	
@@ -1132,7 +1608,7 @@ void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *h
 	packet.src.sin6_family = AF_INET6;
 	memcpy (&packet.src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
 	
-	res = socket_send (miniospf->socket, &packet);
+	res = socket_send (ospf_link->socket, &packet);
 	
 	if (res < 0) {
 		perror ("Sendto");
@@ -1140,7 +1616,7 @@ void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *h
 }
 
 void ospf_process_ack (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header) {
-	ShortLSA *ack;
+	LSAView ack;
 	OSPFNeighbor *vecino;
 	int len;
 	int h;
@@ -1159,27 +1635,27 @@ void ospf_process_ack (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *head
 	
 	len = 0; 
 	
-	/* 16 = Tamaño de la cabecera de OSPF */
-	while (len < header->len - 16) { /* Recorrer mientras haya LSA ACKs */
-		ack = (ShortLSA *) &header->buffer[len];
-		ack->age = ntohs (ack->age);
-		ack->seq_num = ntohl (ack->seq_num);
-		ack->length = ntohs (ack->length);
-		ack->link_state_id = ntohl (ack->link_state_id);
-		ack->type = ntohs (ack->type);
-		
+	/* 16 = Tamaño de la cabecera de OSPF. Recorrer mientras haya LSA ACKs completos */
+	while (lsa_view_init (&ack, header->buffer, header->len - 16, len) == 0) {
 		/* Si es un ACK para nuestro LSA, borrar la bandera de actualización pendiente */
-		ospf_neighbor_remove_update (vecino, ack);
+		ospf_neighbor_remove_update (vecino, &ack);
 		
 		len = len + 20;
 	}
+	
+	if (vecino->updates == NULL) {
+		/* Ya no hay nada que retransmitir */
+		timers_cancel (&miniospf->timers, &vecino->update_timer);
+		vecino->update_rxmt_msec = 0;
+	}
 }
 
 void ospf_resend_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino) {
 	GList *g;
 	ShortLSA *other;
-	int h, pos, update_count, len, pos_len;
+	int h, pos, update_count, pos_len;
 	OSPFPacket packet;
+	struct iovec segments[SOCKET_SEND_SEGMENTS];
 	uint32_t t32;
 	
 	if (vecino->way != FULL) {
@@ -1196,10 +1672,11 @@ void ospf_resend_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *
 	
 	for (g = vecino->updates; g != NULL; g = g->next) {
 		other = (ShortLSA *) g->data;
-		for (h = 0; h < miniospf->n_lsas; h++) {
+		for (h = 0; h < miniospf->n_lsas && update_count < SOCKET_SEND_SEGMENTS; h++) {
 			if (lsa_match_short_complete (&miniospf->lsas[h], other) == 0) {
-				len = lsa_write_lsa (&packet.buffer[pos], &miniospf->lsas[h]);
-				pos += len;
+				lsa_image_set_age (&miniospf->lsas[h]);
+				segments[update_count].iov_base = miniospf->lsas[h].image;
+				segments[update_count].iov_len = miniospf->lsas[h].image_len;
 				update_count++;
 			}
 		}
@@ -1208,7 +1685,7 @@ void ospf_resend_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *
 	t32 = htonl (update_count);
 	memcpy (&packet.buffer[pos_len], &t32, sizeof (uint32_t));
 	
-	ospf_fill_header_end (packet.buffer, pos);
+	ospf_fill_header_end_segments (packet.buffer, pos, segments, update_count);
 	packet.length = pos;
 	
 	int res;
@@ -1221,14 +1698,15 @@ void ospf_resend_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *
 	packet.src.sin6_family = AF_INET6;
 	memcpy (&packet.src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
 	
-	res = socket_send (miniospf->socket, &packet);
+	res = socket_sendv (ospf_link->socket, &packet, segments, update_count);
 	
 	if (res < 0) {
 		perror ("Sendto");
-		return;
+	} else {
+		clock_gettime (CLOCK_MONOTONIC, &vecino->update_last_sent_time);
 	}
 	
-	clock_gettime (CLOCK_MONOTONIC, &vecino->update_last_sent_time);
+	timers_add_msec (&miniospf->timers, &vecino->update_timer, _ospf_rxmt_delay (vecino, &vecino->update_rxmt_msec));
 }
 
 void ospf_send_update (OSPFMini *miniospf) {
@@ -1236,7 +1714,7 @@ void ospf_send_update (OSPFMini *miniospf) {
 	OSPFPacket packet;
 	size_t pos, pos_len;
 	uint32_t t32;
-	int len;
+	struct iovec segments[SOCKET_SEND_SEGMENTS];
 	OSPFNeighbor *vecino, *bdr;
 	int g;
 	int update_count;
@@ -1266,10 +1744,11 @@ void ospf_send_update (OSPFMini *miniospf) {
 	pos += 4;
 	
 	update_count = 0;
-	for (g = 0; g < miniospf->n_lsas; g++) {
+	for (g = 0; g < miniospf->n_lsas && update_count < SOCKET_SEND_SEGMENTS; g++) {
 		if (miniospf->lsas[g].need_update) {
-			len = lsa_write_lsa (&packet.buffer[pos], &miniospf->lsas[g]);
-			pos += len;
+			lsa_image_set_age (&miniospf->lsas[g]);
+			segments[update_count].iov_base = miniospf->lsas[g].image;
+			segments[update_count].iov_len = miniospf->lsas[g].image_len;
 			update_count++;
 		}
 	}
@@ -1277,7 +1756,7 @@ void ospf_send_update (OSPFMini *miniospf) {
 	t32 = htonl (update_count);
 	memcpy (&packet.buffer[pos_len], &t32, sizeof (uint32_t));
 	
-	ospf_fill_header_end (packet.buffer, pos);
+	ospf_fill_header_end_segments (packet.buffer, pos, segments, update_count);
 	packet.length = pos;
 	
 	int res;
@@ -1290,7 +1769,7 @@ void ospf_send_update (OSPFMini *miniospf) {
 	packet.src.sin6_family = AF_INET6;
 	memcpy (&packet.src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
 	
-	res = socket_send (miniospf->socket, &packet);
+	res = socket_sendv (ospf_link->socket, &packet, segments, update_count);
 	
 	if (res < 0) {
 		perror ("Sendto");
@@ -1304,70 +1783,20 @@ void ospf_send_update (OSPFMini *miniospf) {
 		if (miniospf->lsas[g].need_update) {
 			ospf_neighbor_add_update (vecino, &miniospf->lsas[g]);
 			vecino->update_last_sent_time = now;
+			vecino->update_rxmt_msec = 0;
+			timers_add_msec (&miniospf->timers, &vecino->update_timer, _ospf_rxmt_delay (vecino, &vecino->update_rxmt_msec));
 			
 			if (bdr != NULL) {
 				ospf_neighbor_add_update (bdr, &miniospf->lsas[g]);
 				bdr->update_last_sent_time = now;
+				bdr->update_rxmt_msec = 0;
+				timers_add_msec (&miniospf->timers, &bdr->update_timer, _ospf_rxmt_delay (bdr, &bdr->update_rxmt_msec));
 			}
 			miniospf->lsas[g].need_update = 0;
 		}
 	}
 }
 
-void ospf_check_neighbors (OSPFMini *miniospf, struct timespec now) {
-	OSPFLink *ospf_link = miniospf->ospf_link;
-	GList *g;
-	OSPFNeighbor *vecino;
-	struct timespec elapsed;
-	
-	int vecino_changed = 0;
-	/* Recorrer todos los vecinos, buscar vecinos muertos para eliminar y correr las elecciones otra vez */
-	g = ospf_link->neighbors;
-	while (g != NULL) {
-		vecino = (OSPFNeighbor *) g->data;
-		elapsed = timespec_diff (vecino->last_seen, now);
-		
-		g = g->next;
-		if (elapsed.tv_sec >= ospf_link->dead_router_interval) {
-			/* Timeout para este vecino, matarlo */
-			ospf_del_neighbor (ospf_link, vecino);
-			
-			vecino_changed = 1;
-		}
-		
-		/* Revisar si estamos en EX_START o EXCHANGE con master, para reenviar el DD */
-		if (vecino->way == EX_START || (vecino->way == EXCHANGE && IS_SET_DD_MS (vecino->dd_flags))) {
-			elapsed = timespec_diff (vecino->dd_last_sent_time, now);
-			
-			if (elapsed.tv_sec >= /* Retransmit interval */ 10) {
-				ospf_resend_dd (miniospf, ospf_link, vecino);
-			}
-		}
-		
-		/* Si estamos estado EXCHANGE o LOADING, y no he recibido el update correspondiente a mi request, reenviar mi request */
-		if (vecino->requests_pending > 0 && (vecino->way == EXCHANGE || vecino->way == LOADING)) {
-			elapsed = timespec_diff (vecino->request_last_sent_time, now);
-			
-			if (elapsed.tv_sec >= /* Retransmit interval */ 10) {
-				ospf_send_req (miniospf, ospf_link, vecino);
-			}
-		}
-		
-		/* Si estamos en FULL, y tenemos un update pendiente, reenviar el update */
-		if (vecino->updates != NULL && vecino->way == FULL) {
-			elapsed = timespec_diff (vecino->update_last_sent_time, now);
-			
-			if (elapsed.tv_sec >= /* Retransmit interval */ 10) {
-				ospf_resend_update (miniospf, ospf_link, vecino);
-			}
-		}
-	}
-	
-	if (vecino_changed == 1) {
-		ospf_dr_election (miniospf, ospf_link);
-	}
-}
-
 int ospf_validate_header (unsigned char *buffer, uint16_t len, OSPFHeader *header) {
 	uint16_t chck, calc_chck;
 	unsigned char type;
@@ -1436,78 +1865,31 @@ void ospf_fill_header_end (unsigned char *buffer, uint16_t len) {
 	/* El checksum es configurado por IPv6 */
 }
 
-void ospf_send_hello (OSPFMini *miniospf) {
-	OSPFLink *ospf_link = miniospf->ospf_link;
-	GList *g;
-	OSPFPacket packet;
-	size_t pos;
-	uint16_t hello_interval = htons (ospf_link->hello_interval);
-	uint16_t dead_interval = htons (ospf_link->dead_router_interval);
-	OSPFNeighbor *vecino;
-	uint32_t v32;
-	
-	ospf_fill_header (1, packet.buffer, miniospf->config.router_id, ospf_link->area, miniospf->config.instance_id);
-	pos = 16;
-	
-	v32 = htonl (ospf_link->iface->index);
-	memcpy (&packet.buffer[pos], &v32, sizeof (uint32_t));
-	pos = pos + 4;
-	
-	/* La prioridad */
-	packet.buffer[pos] = 0; /* Router priority */
-	pos++;
+/* Como ospf_fill_header_end, pero el resto del paquete va en "segments", fuera del buffer */
+void ospf_fill_header_end_segments (unsigned char *buffer, uint16_t header_len, struct iovec *segments, int n_segments) {
+	size_t len;
+	int g;
 	
-#if 0
-	/* FIXME: Revisar las opciones de IPv6 */
-	if (ospf_link->area_type == OSPF_AREA_STANDARD) {
-		packet.buffer[pos++] = 0x02; /* External Routing */
-	} else if (ospf_link->area_type == OSPF_AREA_STUB) {
-		packet.buffer[pos++] = 0x00;
-	} else if (ospf_link->area_type == OSPF_AREA_NSSA) {
-		packet.buffer[pos++] = 0x08;
+	len = header_len;
+	for (g = 0; g < n_segments; g++) {
+		len += segments[g].iov_len;
 	}
-#endif
-	packet.buffer[pos++] = 0;
-	packet.buffer[pos++] = 0;
-	packet.buffer[pos++] = 0x13;
 	
-	memcpy (&packet.buffer[pos], &hello_interval, sizeof (hello_interval));
-	pos = pos + 2;
-	
-	memcpy (&packet.buffer[pos], &dead_interval, sizeof (dead_interval));
-	pos = pos + 2;
-	
-	memcpy (&packet.buffer[pos], &ospf_link->designated, sizeof (uint32_t));
-	pos = pos + 4;
-	
-	memcpy (&packet.buffer[pos], &ospf_link->backup, sizeof (uint32_t));
-	pos = pos + 4;
+	ospf_fill_header_end (buffer, len);
+}
+
+void ospf_send_hello (OSPFMini *miniospf) {
+	OSPFLink *ospf_link = miniospf->ospf_link;
+	int res;
 	
-	g = ospf_link->neighbors;
-	while (g != NULL) {
-		vecino = (OSPFNeighbor *) g->data;
-		
-		/* Agregar al vecino para que me reconozca */
-		memcpy (&packet.buffer[pos], &vecino->router_id, sizeof (uint32_t));
-		pos = pos + 4;
+	if (ospf_link->hello == NULL) {
+		ospf_link->hello = _ospf_hello_build (miniospf, ospf_link);
 		
-		g = g->next;
+		if (ospf_link->hello == NULL) return;
 	}
 	
-	ospf_fill_header_end (packet.buffer, pos);
-	packet.length = pos;
-	
-	int res;
-	
-	/* Armar la información de packet info */
-	packet.dst.sin6_family = AF_INET6;
-	packet.dst.sin6_scope_id = ospf_link->iface->index;
-	memcpy (&packet.dst.sin6_addr, &miniospf->all_ospf_routers_addr, sizeof (struct in6_addr));
-	
-	packet.src.sin6_family = AF_INET6;
-	memcpy (&packet.src.sin6_addr, &ospf_link->link_local_addr->sin6_addr, sizeof (struct in6_addr));
-	
-	res = socket_send (miniospf->socket, &packet);
+	/* La cola toma una referencia, si se parcha antes de salir se trabaja sobre una copia */
+	res = socket_send_ref (ospf_link->socket, ospf_link->hello);
 	
 	if (res < 0) {
 		perror ("Sendto");
@@ -6,6 +6,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "common6.h"
 
@@ -20,11 +21,24 @@
 #define IS_SET_DD_I(X)          ((X) & OSPF_DD_FLAG_I)
 #define IS_SET_DD_ALL(X)        ((X) & OSPF_DD_FLAG_ALL)
 
+/* Tiempo mínimo entre dos instancias aceptadas del mismo LSA, en milisegundos */
+#define OSPF_MIN_LS_ARRIVAL 1000
+
+/* Hellos adelantados: espera para juntar varios disparos y separación mínima entre dos, en milisegundos */
+#define OSPF_TRIGGERED_HELLO_DELAY 10
+#define OSPF_TRIGGERED_HELLO_HOLD 1000
+
+/* Posiciones en el hello del DR (seguido del BDR) y de la lista de vecinos:
+ * cabecera (16), interface id, prioridad, opciones, hello y dead interval */
+#define OSPF_HELLO_DR_POS 28
+#define OSPF_HELLO_NEIGHBORS_POS 36
+
 void ospf_configure_router_id (OSPFMini *miniospf);
 OSPFLink *ospf_create_iface (OSPFMini *miniospf, Interface *iface);
 void ospf_destroy_link (OSPFMini *miniospf, OSPFLink *ospf_link);
 int ospf_validate_header (unsigned char *buffer, uint16_t len, OSPFHeader *header);
 void ospf_send_hello (OSPFMini *miniospf);
+void ospf_trigger_hello (OSPFMini *miniospf, OSPFLink *ospf_link);
 int ospf_has_full_dr (OSPFMini *miniospf);
 OSPFNeighbor *ospf_locate_neighbor (OSPFLink *ospf_link, uint32_t router_id);
 void ospf_dr_election (OSPFMini *miniospf, OSPFLink *ospf_link);
@@ -33,12 +47,12 @@ void ospf_send_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino
 void ospf_process_dd (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_fill_header (int type, unsigned char *buffer, uint32_t router_id, uint32_t area, uint8_t instance_id);
 void ospf_fill_header_end (unsigned char *buffer, uint16_t len);
+void ospf_fill_header_end_segments (unsigned char *buffer, uint16_t header_len, struct iovec *segments, int n_segments);
 void ospf_process_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_send_update (OSPFMini *miniospf);
 void ospf_process_update (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 void ospf_neighbor_state_change (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino, int state);
 void ospf_send_req (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFNeighbor *vecino);
-void ospf_check_neighbors (OSPFMini *miniospf, struct timespec now);
 void ospf_del_neighbor (OSPFLink *ospf_link, OSPFNeighbor *vecino);
 void ospf_process_ack (OSPFMini *miniospf, OSPFLink *ospf_link, OSPFHeader *header);
 
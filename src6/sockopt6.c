@@ -1,3 +1,6 @@
+/* Para recvmmsg y sendmmsg */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,10 +14,107 @@
 
 #include <fcntl.h>
 
+#include <linux/filter.h>
+
 #include <errno.h>
 
 #include "common6.h"
 #include "sockopt6.h"
+#include "uring.h"
+#include "packet-ring.h"
+#include "packet-pool.h"
+#include "utils.h"
+
+#define SOCKET_URING_SEND_SLOTS  64
+#define SOCKET_URING_BUFFERS     64
+#define SOCKET_URING_BUFFER_SIZE 4096
+#define SOCKET_URING_BGID        1
+
+typedef union {
+	struct cmsghdr cm;
+	char control[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+} SocketSendControl;
+
+typedef union {
+	struct cmsghdr cm;
+	char control[CMSG_SPACE(sizeof(struct in6_addr)) +
+	             CMSG_SPACE(sizeof(struct in6_pktinfo)) +
+	             CMSG_SPACE(sizeof(uint32_t)) +
+	             CMSG_SPACE(sizeof(struct timespec))];
+} SocketRecvControl;
+
+/* Anillo de recepción para recvmmsg, cada ranura con su propio buffer de control */
+static struct {
+	OSPFPacket packets[SOCKET_RECV_BATCH];
+	struct mmsghdr msgs[SOCKET_RECV_BATCH];
+	struct iovec iovs[SOCKET_RECV_BATCH];
+	SocketRecvControl controls[SOCKET_RECV_BATCH];
+} socket_recv_ring;
+
+/* Cola de salida, se entrega con sendmmsg una vez por vuelta del ciclo principal.
+ * Cada ranura guarda su socket y una referencia a un paquete del pool.
+ * Los paquetes pendientes ocupan las primeras "count" ranuras, en orden de llegada */
+static struct {
+	OSPFPacket *packets[SOCKET_SEND_QUEUE];
+	int fds[SOCKET_SEND_QUEUE];
+	struct mmsghdr msgs[SOCKET_SEND_QUEUE];
+	struct iovec iovs[SOCKET_SEND_QUEUE];
+	SocketSendControl controls[SOCKET_SEND_QUEUE];
+	
+	int count;
+} socket_send_queue;
+
+/* Paquetes con cuenta de referencias, para la cola de salida y los DD de cada vecino */
+static PacketPool socket_pool;
+
+/* SO_RXQ_OVFL es acumulado por socket: guardar el último valor de cada uno
+ * y sumar solo lo que avanzó, así con -s el total incluye todos los sockets */
+#define SOCKET_DROP_SOCKETS 64
+
+static struct {
+	struct {
+		int s;
+		uint32_t last;
+	} sockets[SOCKET_DROP_SOCKETS];
+	int count;
+	
+	unsigned long total;
+} socket_drops;
+
+/* Recepción por un anillo AF_PACKET, el socket raw queda solo para enviar */
+static struct {
+	PacketRing *ring;
+} socket_ring;
+
+/* Un envío encolado en io_uring, todo debe seguir vivo hasta su terminación */
+typedef struct {
+	OSPFPacket packet;
+	struct msghdr msg;
+	struct iovec iov;
+	SocketSendControl control_un;
+	int in_use;
+} SocketSendSlot;
+
+static struct {
+	URing *ring;
+	int s;
+	
+	URingBufferGroup buffers;
+	
+	/* Plantilla del recvmsg multishot, solo importan los tamaños de nombre y control */
+	struct msghdr recv_msg;
+	
+	SocketSendSlot slots[SOCKET_URING_SEND_SLOTS];
+	int next_slot;
+	int in_flight;
+	
+	/* El recvmsg multishot se abandonó, el socket se lee con epoll */
+	int recv_stopped;
+	
+	/* Paquetes que pasaron por el anillo, para las estadísticas */
+	unsigned long received;
+	unsigned long sent;
+} socket_uring;
 
 int socket_create (void) {
 	int s;
@@ -56,9 +156,119 @@ int socket_create (void) {
 	s = -1;
 #endif
 	
+	/* Cada recvmsg trae el total de paquetes descartados por el kernel */
+	g = 1;
+	if (s >= 0 && setsockopt (s, SOL_SOCKET, SO_RXQ_OVFL, &g, sizeof (g)) < 0) {
+		perror ("SO_RXQ_OVFL");
+	}
+	
+	/* Marca de llegada del kernel, para medir cuánto esperó el paquete antes de procesarse */
+	if (s >= 0 && setsockopt (s, SOL_SOCKET, SO_TIMESTAMPNS, &g, sizeof (g)) < 0) {
+		perror ("SO_TIMESTAMPNS");
+	}
+	
+	/* El pool es uno solo para todos los sockets */
+	if (socket_pool.size == 0) {
+		packet_pool_init (&socket_pool, sizeof (OSPFPacket), SOCKET_SEND_QUEUE);
+	}
+	
 	return s;
 }
 
+/* Atar el socket a una interfaz: solo recibe lo que llega por ella y solo envía por ella */
+int socket_bind_device (int s, const char *iface_name) {
+	if (setsockopt (s, SOL_SOCKET, SO_BINDTODEVICE, iface_name, strlen (iface_name) + 1) < 0) {
+		perror ("SO_BINDTODEVICE");
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Tamaño de los buffers del kernel para el socket, en bytes, 0 para dejar el del sistema.
+ * Primero se intenta la versión FORCE, que ignora rmem_max/wmem_max si tenemos CAP_NET_ADMIN */
+int socket_set_buffers (int s, int rcvbuf, int sndbuf) {
+	int ret = 0;
+	
+	if (rcvbuf > 0 && setsockopt (s, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof (rcvbuf)) < 0) {
+		if (setsockopt (s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf)) < 0) {
+			perror ("SO_RCVBUF");
+			ret = -1;
+		}
+	}
+	
+	if (sndbuf > 0 && setsockopt (s, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof (sndbuf)) < 0) {
+		if (setsockopt (s, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof (sndbuf)) < 0) {
+			perror ("SO_SNDBUF");
+			ret = -1;
+		}
+	}
+	
+	return ret;
+}
+
+/* Marcar los paquetes que salen por el socket como tráfico de control:
+ * "dscp" va en el Traffic Class de la cabecera IPv6 (CS6 = 48), "priority" elige la banda
+ * de la qdisc local (7 = TC_PRIO_CONTROL). Un valor negativo deja el del sistema */
+int socket_set_priority (int s, int dscp, int priority) {
+	int tclass;
+	int ret = 0;
+	
+	if (dscp >= 0) {
+		tclass = dscp << 2;
+		if (setsockopt (s, IPPROTO_IPV6, IPV6_TCLASS, &tclass, sizeof (tclass)) < 0) {
+			perror ("IPV6_TCLASS");
+			ret = -1;
+		}
+	}
+	
+	if (priority >= 0 && setsockopt (s, SOL_SOCKET, SO_PRIORITY, &priority, sizeof (priority)) < 0) {
+		perror ("SO_PRIORITY");
+		ret = -1;
+	}
+	
+	return ret;
+}
+
+/* Paquetes que el kernel descartó por buffer lleno, según el último SO_RXQ_OVFL recibido */
+unsigned long socket_rx_drops (void) {
+	return socket_drops.total;
+}
+
+static void _socket_count_drops (int s, uint32_t value) {
+	int g;
+	
+	for (g = 0; g < socket_drops.count; g++) {
+		if (socket_drops.sockets[g].s == s) break;
+	}
+	
+	if (g == socket_drops.count) {
+		if (socket_drops.count == SOCKET_DROP_SOCKETS) return;
+		
+		socket_drops.sockets[g].s = s;
+		socket_drops.sockets[g].last = 0;
+		socket_drops.count++;
+	}
+	
+	/* Resta sin signo, sobrevive a que el contador del kernel dé la vuelta */
+	socket_drops.total += (uint32_t) (value - socket_drops.sockets[g].last);
+	socket_drops.sockets[g].last = value;
+}
+
+/* Un descriptor reutilizado empieza su propia cuenta */
+static void _socket_forget_drops (int s) {
+	int g;
+	
+	for (g = 0; g < socket_drops.count; g++) {
+		if (socket_drops.sockets[g].s == s) {
+			socket_drops.count--;
+			socket_drops.sockets[g] = socket_drops.sockets[socket_drops.count];
+			break;
+		}
+	}
+}
+
 int socket_non_blocking (int s) {
 	int flags;
 	
@@ -76,29 +286,15 @@ int socket_non_blocking (int s) {
 	return 0;
 }
 
-ssize_t socket_send (int s, OSPFPacket *packet) {
-	ssize_t ret;
-	struct msghdr msg;
-	struct iovec iov;
+static void _socket_prepare_send (OSPFPacket *packet, struct msghdr *msg, struct iovec *iov, SocketSendControl *control_un) {
 	struct cmsghdr *cmptr;
 	struct in6_pktinfo *pktinfo;
-	char buffer_ip[2048];
-	
-	inet_ntop (AF_INET6, &packet->src.sin6_addr, buffer_ip, sizeof (buffer_ip));
-	//printf ("Send: SRC: %s,", buffer_ip);
-	inet_ntop (AF_INET6, &packet->dst.sin6_addr, buffer_ip, sizeof (buffer_ip));
-	//printf ("DST: %s, src interface: %i, dst interface: %i\n", buffer_ip, packet->src.sin6_scope_id, packet->dst.sin6_scope_id);
 	
-	union {
-		struct cmsghdr cm;
-		char control[CMSG_SPACE(sizeof(struct in6_pktinfo))];
-	} control_un;
+	msg->msg_control = control_un->control;
+	msg->msg_controllen = sizeof (control_un->control);
+	msg->msg_flags = 0;
 	
-	msg.msg_control = control_un.control;
-	msg.msg_controllen = sizeof (control_un.control);
-	msg.msg_flags = 0;
-	
-	cmptr = CMSG_FIRSTHDR (&msg);
+	cmptr = CMSG_FIRSTHDR (msg);
 	cmptr->cmsg_level = IPPROTO_IPV6;
 	cmptr->cmsg_type = IPV6_PKTINFO;
 	cmptr->cmsg_len = CMSG_LEN (sizeof(struct in6_pktinfo));
@@ -109,34 +305,423 @@ ssize_t socket_send (int s, OSPFPacket *packet) {
 	memcpy (&pktinfo->ipi6_addr, &packet->src.sin6_addr, sizeof (struct in6_addr));
 	pktinfo->ipi6_ifindex = packet->dst.sin6_scope_id;
 	
+	msg->msg_name = &packet->dst;
+	msg->msg_namelen = sizeof (packet->dst);
+	iov->iov_base = packet->buffer;
+	iov->iov_len = packet->length;
+	msg->msg_iov = iov;
+	msg->msg_iovlen = 1;
+}
+
+/* Copia el paquete, seguido de "segments", a una ranura libre y lo encola, se envía en el siguiente uring_submit.
+ * El tamaño total ya debe estar revisado */
+static ssize_t _socket_uring_sendv (OSPFPacket *packet, struct iovec *segments, int n_segments) {
+	SocketSendSlot *slot;
+	int g, pos;
+	
+	for (g = 0; g < SOCKET_URING_SEND_SLOTS; g++) {
+		pos = (socket_uring.next_slot + g) % SOCKET_URING_SEND_SLOTS;
+		
+		if (socket_uring.slots[pos].in_use == 0) break;
+	}
+	
+	if (g == SOCKET_URING_SEND_SLOTS) return -1;
+	
+	slot = &socket_uring.slots[pos];
+	memcpy (&slot->packet, packet, sizeof (OSPFPacket));
+	for (g = 0; g < n_segments; g++) {
+		memcpy (&slot->packet.buffer[slot->packet.length], segments[g].iov_base, segments[g].iov_len);
+		slot->packet.length += segments[g].iov_len;
+	}
+	_socket_prepare_send (&slot->packet, &slot->msg, &slot->iov, &slot->control_un);
+	
+	if (uring_sendmsg (socket_uring.ring, socket_uring.s, &slot->msg, URING_TAG (URING_KIND_OSPF_SEND, pos)) < 0) {
+		return -1;
+	}
+	
+	slot->in_use = 1;
+	socket_uring.in_flight++;
+	socket_uring.next_slot = (pos + 1) % SOCKET_URING_SEND_SLOTS;
+	
+	return slot->packet.length;
+}
+
+static ssize_t _socket_uring_send (OSPFPacket *packet) {
+	return _socket_uring_sendv (packet, NULL, 0);
+}
+
+/* Un paquete del pool, con una referencia para quien lo pide */
+OSPFPacket *socket_packet_new (void) {
+	return (OSPFPacket *) packet_pool_get (&socket_pool);
+}
+
+void socket_packet_unref (OSPFPacket *packet) {
+	packet_pool_unref (packet);
+}
+
+/* Copia a un paquete del pool las direcciones y solo los bytes ocupados del buffer */
+static OSPFPacket *_socket_packet_copy (OSPFPacket *packet) {
+	OSPFPacket *copy;
+	
+	copy = socket_packet_new ();
+	
+	if (copy == NULL) return NULL;
+	
+	memcpy (&copy->dst, &packet->dst, sizeof (packet->dst));
+	memcpy (&copy->src, &packet->src, sizeof (packet->src));
+	copy->length = packet->length;
+	memcpy (copy->buffer, packet->buffer, packet->length);
+	
+	return copy;
+}
+
+/* Para modificar un paquete del pool que puede seguir en la cola de envío:
+ * si alguien más lo referencia, devuelve una copia y suelta el original.
+ * Si no hay memoria para la copia devuelve NULL, y el original no se toca */
+OSPFPacket *socket_packet_unshare (OSPFPacket *packet) {
+	OSPFPacket *copy;
+	
+	if (!packet_pool_shared (packet)) return packet;
+	
+	copy = _socket_packet_copy (packet);
+	
+	if (copy == NULL) return NULL;
+	
+	socket_packet_unref (packet);
+	
+	return copy;
+}
+
+/* Encola un paquete del pool, la cola toma su propia referencia */
+static ssize_t _socket_queue_send (int s, OSPFPacket *packet) {
+	int pos;
+	
+	if (socket_send_queue.count == SOCKET_SEND_QUEUE) {
+		/* Cola llena, intentar vaciarla antes de agregar */
+		socket_flush ();
+		
+		if (socket_send_queue.count == SOCKET_SEND_QUEUE) {
+			errno = ENOBUFS;
+			
+			return -1;
+		}
+	}
+	
+	pos = socket_send_queue.count;
+	socket_send_queue.packets[pos] = (OSPFPacket *) packet_pool_ref (packet);
+	socket_send_queue.fds[pos] = s;
+	_socket_prepare_send (packet, &socket_send_queue.msgs[pos].msg_hdr, &socket_send_queue.iovs[pos], &socket_send_queue.controls[pos]);
+	
+	socket_send_queue.count++;
+	
+	return packet->length;
+}
+
+/* Mueve la ranura "from" a "to" (to < from), los apuntadores del mensaje siguen a su ranura */
+static void _socket_queue_move (int from, int to) {
+	struct msghdr *msg;
+	
+	socket_send_queue.packets[to] = socket_send_queue.packets[from];
+	socket_send_queue.fds[to] = socket_send_queue.fds[from];
+	socket_send_queue.iovs[to] = socket_send_queue.iovs[from];
+	socket_send_queue.controls[to] = socket_send_queue.controls[from];
+	socket_send_queue.msgs[to] = socket_send_queue.msgs[from];
+	
+	msg = &socket_send_queue.msgs[to].msg_hdr;
+	msg->msg_iov = &socket_send_queue.iovs[to];
+	msg->msg_control = socket_send_queue.controls[to].control;
+}
+
+static int _socket_fd_blocked (int *blocked, int n_blocked, int s) {
+	int g;
+	
+	for (g = 0; g < n_blocked; g++) {
+		if (blocked[g] == s) return 1;
+	}
+	
+	return 0;
+}
+
+/* Entrega la cola de salida con sendmmsg, una llamada por cada grupo seguido de paquetes del mismo socket.
+ * Si un socket no acepta todo (EAGAIN), sus paquetes restantes se quedan en la cola para la siguiente vuelta,
+ * sin detener a los otros sockets. Lo que queda se recorre al inicio de la cola.
+ * Devuelve cuántos paquetes quedan pendientes */
+int socket_flush (void) {
+	int blocked[SOCKET_SEND_QUEUE];
+	int n_blocked, pos, keep, run, ret, g, s;
+	
+	n_blocked = 0;
+	keep = 0;
+	pos = 0;
+	while (pos < socket_send_queue.count) {
+		s = socket_send_queue.fds[pos];
+		
+		if (_socket_fd_blocked (blocked, n_blocked, s)) {
+			/* Este socket está lleno, conservar el paquete en su orden */
+			if (keep != pos) _socket_queue_move (pos, keep);
+			keep++;
+			pos++;
+			continue;
+		}
+		
+		for (run = 1; pos + run < socket_send_queue.count && socket_send_queue.fds[pos + run] == s; run++);
+		
+		ret = sendmmsg (s, &socket_send_queue.msgs[pos], run, 0);
+		
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				blocked[n_blocked++] = s;
+				continue;
+			}
+			
+			/* Error con el primer paquete, descartarlo y seguir con el resto */
+			perror ("Sendmmsg");
+			ret = 1;
+		}
+		
+		for (g = 0; g < ret; g++) {
+			packet_pool_unref (socket_send_queue.packets[pos + g]);
+		}
+		
+		pos += ret;
+	}
+	
+	socket_send_queue.count = keep;
+	
+	return keep;
+}
+
+/* Cierra un socket, descartando lo que le quede en la cola de salida */
+void socket_close (int s) {
+	int g, keep;
+	
+	socket_flush ();
+	
+	keep = 0;
+	for (g = 0; g < socket_send_queue.count; g++) {
+		if (socket_send_queue.fds[g] == s) {
+			packet_pool_unref (socket_send_queue.packets[g]);
+			continue;
+		}
+		
+		if (keep != g) _socket_queue_move (g, keep);
+		keep++;
+	}
+	
+	socket_send_queue.count = keep;
+	
+	_socket_forget_drops (s);
+	close (s);
+}
+
+ssize_t socket_send (int s, OSPFPacket *packet) {
+	ssize_t ret;
+	OSPFPacket *copy;
+	struct msghdr msg;
+	struct iovec iov;
+	SocketSendControl control_un;
+	
 	packet->dst.sin6_family = AF_INET6;
 	packet->dst.sin6_port = 0;
 	packet->dst.sin6_flowinfo = 0;
 	
-	msg.msg_name = &packet->dst;
-	msg.msg_namelen = sizeof (packet->dst);
-	iov.iov_base = packet->buffer;
-	iov.iov_len = packet->length;
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
+	if (socket_uring.ring != NULL && s == socket_uring.s) {
+		ret = _socket_uring_send (packet);
+		
+		if (ret >= 0) return ret;
+		
+		/* Sin ranuras libres. Entregar lo encolado para no desordenar los paquetes,
+		 * y enviar este directamente */
+		uring_submit (socket_uring.ring, 0);
+		
+		_socket_prepare_send (packet, &msg, &iov, &control_un);
+		
+		ret = sendmsg (s, &msg, 0);
+		
+		return ret;
+	}
 	
-	ret = sendmsg (s, &msg, 0);
+	/* La cola guarda paquetes del pool, copiar solo lo que ocupa este */
+	copy = _socket_packet_copy (packet);
+	
+	if (copy == NULL) {
+		errno = ENOBUFS;
+		
+		return -1;
+	}
+	
+	ret = _socket_queue_send (s, copy);
+	socket_packet_unref (copy);
 	
 	return ret;
 }
 
-ssize_t socket_recv (int s, OSPFPacket *packet) {
+/* Como socket_send, para un paquete de socket_packet_new que se va a reenviar,
+ * como el último DD de un vecino: la cola toma una referencia en lugar de copiarlo */
+ssize_t socket_send_ref (int s, OSPFPacket *packet) {
+	packet->dst.sin6_family = AF_INET6;
+	packet->dst.sin6_port = 0;
+	packet->dst.sin6_flowinfo = 0;
+	
+	if (socket_uring.ring != NULL && s == socket_uring.s) {
+		return socket_send (s, packet);
+	}
+	
+	return _socket_queue_send (s, packet);
+}
+
+/* Envía "packet" (direcciones y los primeros "length" bytes del buffer) seguido de "segments",
+ * sin copiarlos, con un solo sendmsg. Los segmentos solo tienen que vivir durante la llamada.
+ * Solo sale directo si la cola está vacía; si no, o si el socket está lleno, el paquete se arma
+ * completo en el pool y se encola detrás, y sale con el resto al final de la iteración.
+ * Con io_uring los envíos anteriores pueden seguir en vuelo, así que el paquete se arma
+ * en una ranura y sale como SQE detrás de ellos */
+ssize_t socket_sendv (int s, OSPFPacket *packet, struct iovec *segments, int n_segments) {
 	ssize_t ret;
+	OSPFPacket *copy;
 	struct msghdr msg;
-	struct iovec iov;
+	struct iovec iov[SOCKET_SEND_SEGMENTS + 1];
+	SocketSendControl control_un;
+	size_t total;
+	int g;
+	
+	packet->dst.sin6_family = AF_INET6;
+	packet->dst.sin6_port = 0;
+	packet->dst.sin6_flowinfo = 0;
+	
+	if (n_segments > SOCKET_SEND_SEGMENTS) {
+		errno = EMSGSIZE;
+		
+		return -1;
+	}
+	
+	total = packet->length;
+	for (g = 0; g < n_segments; g++) {
+		total += segments[g].iov_len;
+	}
+	
+	if (total > sizeof (packet->buffer)) {
+		errno = EMSGSIZE;
+		
+		return -1;
+	}
+	
+	if (socket_uring.ring != NULL && s == socket_uring.s) {
+		ret = _socket_uring_sendv (packet, segments, n_segments);
+		
+		if (ret >= 0) return ret;
+		
+		/* Sin ranuras libres. Entregar lo encolado para no desordenar los paquetes,
+		 * y enviar este directamente */
+		uring_submit (socket_uring.ring, 0);
+		
+		_socket_prepare_send (packet, &msg, &iov[0], &control_un);
+		
+		for (g = 0; g < n_segments; g++) {
+			iov[g + 1] = segments[g];
+		}
+		msg.msg_iovlen = n_segments + 1;
+		
+		return sendmsg (s, &msg, 0);
+	}
+	
+	if (socket_send_queue.count == 0) {
+		_socket_prepare_send (packet, &msg, &iov[0], &control_un);
+		
+		for (g = 0; g < n_segments; g++) {
+			iov[g + 1] = segments[g];
+		}
+		msg.msg_iovlen = n_segments + 1;
+		
+		ret = sendmsg (s, &msg, 0);
+		
+		if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return ret;
+	}
+	
+	/* Hay paquetes encolados o el socket está lleno, encolar una copia plana */
+	copy = _socket_packet_copy (packet);
+	
+	if (copy == NULL) {
+		errno = ENOBUFS;
+		
+		return -1;
+	}
+	
+	total = packet->length;
+	for (g = 0; g < n_segments; g++) {
+		memcpy (&copy->buffer[total], segments[g].iov_base, segments[g].iov_len);
+		total += segments[g].iov_len;
+	}
+	copy->length = total;
+	
+	ret = _socket_queue_send (s, copy);
+	socket_packet_unref (copy);
+	
+	return ret;
+}
+
+/* El kernel marca la llegada con CLOCK_REALTIME, pasarla a CLOCK_MONOTONIC, el reloj de los timers.
+ * Sin marca, o si el reloj del sistema se movió hacia atrás o adelante, la llegada es ahora */
+static void _socket_rx_time (OSPFPacket *packet, struct timespec *stamp) {
+	struct timespec real_now, age;
+	
+	clock_gettime (CLOCK_MONOTONIC, &packet->rx_time);
+	
+	if (stamp->tv_sec == 0 && stamp->tv_nsec == 0) return;
+	
+	clock_gettime (CLOCK_REALTIME, &real_now);
+	age = timespec_diff (*stamp, real_now);
+	
+	if (age.tv_sec < 0) return;
+	
+	/* Un salto hacia adelante (NTP, el administrador) haría parecer viejo un paquete recién llegado */
+	if (age.tv_sec * 1000 + age.tv_nsec / 1000000 > SOCKET_RX_MAX_AGE) return;
+	
+	packet->rx_time = timespec_diff (age, packet->rx_time);
+}
+
+static void _socket_parse_control (int s, struct msghdr *msg, OSPFPacket *packet) {
 	struct cmsghdr *cmptr;
 	struct in6_pktinfo *pktinfo;
+	struct timespec stamp;
+	uint32_t drops;
 	
-	union {
-		struct cmsghdr cm;
-		char control[CMSG_SPACE(sizeof(struct in6_addr)) +
-		             CMSG_SPACE(sizeof(struct in6_pktinfo))];
-	} control_un;
+	memset (&packet->dst, 0, sizeof (packet->dst));
+	
+	memset (&stamp, 0, sizeof (stamp));
+	
+	if (msg->msg_controllen < sizeof(struct cmsghdr) ||
+	    (msg->msg_flags & MSG_CTRUNC)) {
+		_socket_rx_time (packet, &stamp);
+		return;
+	}
+	for (cmptr = CMSG_FIRSTHDR(msg); cmptr != NULL; cmptr = CMSG_NXTHDR (msg, cmptr)) {
+#ifdef  IPV6_PKTINFO
+		if (cmptr->cmsg_level == IPPROTO_IPV6 && cmptr->cmsg_type == IPV6_PKTINFO) {
+			pktinfo = (struct in6_pktinfo *) CMSG_DATA(cmptr);
+			memcpy (&packet->dst.sin6_addr, &pktinfo->ipi6_addr, sizeof (struct in6_addr));
+			continue;
+		}
+#endif
+		if (cmptr->cmsg_level == SOL_SOCKET && cmptr->cmsg_type == SO_RXQ_OVFL) {
+			memcpy (&drops, CMSG_DATA(cmptr), sizeof (uint32_t));
+			_socket_count_drops (s, drops);
+			continue;
+		}
+		if (cmptr->cmsg_level == SOL_SOCKET && cmptr->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy (&stamp, CMSG_DATA(cmptr), sizeof (struct timespec));
+			continue;
+		}
+	}
+	
+	_socket_rx_time (packet, &stamp);
+}
+
+ssize_t socket_recv (int s, OSPFPacket *packet) {
+	ssize_t ret;
+	struct msghdr msg;
+	struct iovec iov;
+	SocketRecvControl control_un;
 	
 	msg.msg_control = control_un.control;
 	msg.msg_controllen = sizeof (control_un.control);
@@ -154,22 +739,335 @@ ssize_t socket_recv (int s, OSPFPacket *packet) {
 	if (ret < 0) return ret;
 	
 	packet->length = ret;
-	memset (&packet->dst, 0, sizeof (packet->dst));
 	
-	if (msg.msg_controllen < sizeof(struct cmsghdr) ||
-	    (msg.msg_flags & MSG_CTRUNC)) {
-		return ret;
+	_socket_parse_control (s, &msg, packet);
+	
+	return ret;
+}
+
+/* Lee de una vez todos los paquetes pendientes, hasta SOCKET_RECV_BATCH.
+ * Los paquetes quedan en "packets", que es válido hasta la siguiente llamada.
+ * Devuelve cuántos paquetes se leyeron, o -1 con errno como recvmsg */
+int socket_recv_batch (int s, OSPFPacket **packets) {
+	int g, ret;
+	OSPFPacket *packet;
+	struct msghdr *msg;
+	
+	for (g = 0; g < SOCKET_RECV_BATCH; g++) {
+		packet = &socket_recv_ring.packets[g];
+		msg = &socket_recv_ring.msgs[g].msg_hdr;
+		
+		msg->msg_control = socket_recv_ring.controls[g].control;
+		msg->msg_controllen = sizeof (socket_recv_ring.controls[g].control);
+		msg->msg_flags = 0;
+		
+		msg->msg_name = &packet->src;
+		msg->msg_namelen = sizeof (packet->src);
+		socket_recv_ring.iovs[g].iov_base = packet->buffer;
+		socket_recv_ring.iovs[g].iov_len = sizeof (packet->buffer);
+		msg->msg_iov = &socket_recv_ring.iovs[g];
+		msg->msg_iovlen = 1;
 	}
-	for (cmptr = CMSG_FIRSTHDR(&msg); cmptr != NULL; cmptr = CMSG_NXTHDR (&msg, cmptr)) {
-#ifdef  IPV6_PKTINFO
-		if (cmptr->cmsg_level == IPPROTO_IPV6 && cmptr->cmsg_type == IPV6_PKTINFO) {
-			pktinfo = (struct in6_pktinfo *) CMSG_DATA(cmptr);
-			memcpy (&packet->dst.sin6_addr, &pktinfo->ipi6_addr, sizeof (struct in6_addr));
-			continue;
+	
+	/* MSG_WAITFORONE: en un socket bloqueante solo se espera al primer paquete */
+	ret = recvmmsg (s, socket_recv_ring.msgs, SOCKET_RECV_BATCH, MSG_WAITFORONE, NULL);
+	
+	if (ret < 0) return ret;
+	
+	for (g = 0; g < ret; g++) {
+		packet = &socket_recv_ring.packets[g];
+		packet->length = socket_recv_ring.msgs[g].msg_len;
+		
+		_socket_parse_control (s, &socket_recv_ring.msgs[g].msg_hdr, packet);
+	}
+	
+	*packets = socket_recv_ring.packets;
+	
+	return ret;
+}
+
+/* El mismo filtro que socket_set_filter, pero para el anillo AF_PACKET, que ve todo IPv6
+ * desde la cabecera IP: primero se revisa que el siguiente encabezado sea OSPF.
+ * El socket raw se queda sin recibir nada */
+static int _socket_ring_set_filter (int s, OSPFLink *ospf_link) {
+	struct sock_filter code[] = {
+		/* Siguiente encabezado 89, sin cabeceras de extensión */
+		BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 6),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 89, 0, 16),
+		/* Destino multicast: solo ff02::5, el unicast pasa */
+		BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 24),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0xFF, 0, 8),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, 24),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0xFF020000, 0, 12),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, 28),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 10),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, 32),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 8),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, 36),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 5, 0, 6),
+		/* Interfaz de llegada */
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 4),
+		/* Versión 3 */
+		BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 40),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 3, 0, 2),
+		/* Área */
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, 48),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0),
+		BPF_STMT (BPF_RET | BPF_K, 0),
+		BPF_STMT (BPF_RET | BPF_K, 0xFFFFFFFF),
+	};
+	struct sock_filter drop_all[] = {
+		BPF_STMT (BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+	
+	prog.len = sizeof (drop_all) / sizeof (drop_all[0]);
+	prog.filter = drop_all;
+	
+	if (setsockopt (s, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog)) < 0) {
+		perror ("SO_ATTACH_FILTER");
+		
+		return -1;
+	}
+	
+	if (ospf_link == NULL) {
+		return packet_ring_set_filter (socket_ring.ring, drop_all, sizeof (drop_all) / sizeof (drop_all[0]));
+	}
+	
+	code[13].k = ospf_link->iface->index;
+	code[17].k = ntohl (ospf_link->area);
+	
+	return packet_ring_set_filter (socket_ring.ring, code, sizeof (code) / sizeof (code[0]));
+}
+
+/* Filtro BPF en el kernel con las mismas reglas que process_one_packet,
+ * así los paquetes de otra interfaz, otra área o para ff02::6 no llegan a copiarse.
+ * En IPv6 el paquete empieza en la cabecera OSPF, la cabecera IP se lee con SKF_NET_OFF.
+ * Sin enlace, se descarta todo */
+int socket_set_filter (int s, OSPFLink *ospf_link) {
+	struct sock_filter code[] = {
+		/* Destino multicast: solo ff02::5, el unicast pasa */
+		BPF_STMT (BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 24),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0xFF, 0, 8),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 24),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0xFF020000, 0, 12),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 28),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 10),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 32),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 8),
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 36),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 5, 0, 6),
+		/* Interfaz de llegada */
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 4),
+		/* Versión 3 */
+		BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 0),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 3, 0, 2),
+		/* Área */
+		BPF_STMT (BPF_LD | BPF_W | BPF_ABS, 8),
+		BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, 0, 1, 0),
+		BPF_STMT (BPF_RET | BPF_K, 0),
+		BPF_STMT (BPF_RET | BPF_K, 0xFFFFFFFF),
+	};
+	struct sock_filter drop_all[] = {
+		BPF_STMT (BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+	
+	if (socket_ring.ring != NULL) {
+		return _socket_ring_set_filter (s, ospf_link);
+	}
+	
+	if (ospf_link == NULL) {
+		prog.len = sizeof (drop_all) / sizeof (drop_all[0]);
+		prog.filter = drop_all;
+	} else {
+		code[11].k = ospf_link->iface->index;
+		code[15].k = ntohl (ospf_link->area);
+		
+		prog.len = sizeof (code) / sizeof (code[0]);
+		prog.filter = code;
+	}
+	
+	if (setsockopt (s, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof (prog)) < 0) {
+		perror ("SO_ATTACH_FILTER");
+		
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Pasar el socket OSPF a io_uring: un recvmsg multishot sobre un anillo de buffers,
+ * y los envíos encolados como SQE */
+int socket_uring_start (URing *ring, int s) {
+	memset (&socket_uring, 0, sizeof (socket_uring));
+	
+	if (uring_buffers_init (ring, &socket_uring.buffers, SOCKET_URING_BGID, SOCKET_URING_BUFFERS, SOCKET_URING_BUFFER_SIZE) < 0) {
+		return -1;
+	}
+	
+	socket_uring.recv_msg.msg_namelen = sizeof (struct sockaddr_in6);
+	socket_uring.recv_msg.msg_controllen = sizeof (SocketRecvControl);
+	
+	if (uring_recvmsg_multishot (ring, s, &socket_uring.recv_msg, &socket_uring.buffers, URING_TAG (URING_KIND_OSPF_RECV, 0)) < 0) {
+		uring_buffers_destroy (ring, &socket_uring.buffers);
+		
+		return -1;
+	}
+	
+	socket_uring.ring = ring;
+	socket_uring.s = s;
+	
+	return 0;
+}
+
+/* Procesa una terminación del socket OSPF.
+ * Devuelve el tamaño del paquete recibido en "packet", 0 si no hay paquete que procesar,
+ * o -1 si el recvmsg multishot dejó de funcionar y hay que leer el socket directamente */
+/* Paquetes recibidos y enviados por io_uring desde socket_uring_start */
+void socket_uring_counters (unsigned long *received, unsigned long *sent) {
+	*received = socket_uring.received;
+	*sent = socket_uring.sent;
+}
+
+int socket_uring_complete (uint64_t user_data, int res, unsigned int flags, OSPFPacket *packet) {
+	unsigned char *payload;
+	unsigned int payload_len, bid, pos;
+	struct msghdr msg;
+	int ret;
+	
+	if (socket_uring.ring == NULL) return 0;
+	
+	if (URING_TAG_KIND (user_data) == URING_KIND_OSPF_SEND) {
+		pos = URING_TAG_INDEX (user_data);
+		
+		if (pos < SOCKET_URING_SEND_SLOTS && socket_uring.slots[pos].in_use) {
+			socket_uring.slots[pos].in_use = 0;
+			socket_uring.in_flight--;
+			if (res >= 0) socket_uring.sent++;
 		}
-#endif
+		
+		return 0;
+	}
+	
+	if (URING_TAG_KIND (user_data) != URING_KIND_OSPF_RECV) return 0;
+	
+	if (socket_uring.recv_stopped) {
+		/* Terminaciones rezagadas, solo devolver el buffer; el socket ya se lee con epoll */
+		if (flags & IORING_CQE_F_BUFFER) uring_buffer_recycle (&socket_uring.buffers, flags >> IORING_CQE_BUFFER_SHIFT);
+		
+		return 0;
+	}
+	
+	ret = 0;
+	if (flags & IORING_CQE_F_BUFFER) {
+		bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		
+		if (uring_recvmsg_parse (uring_buffer_get (&socket_uring.buffers, bid), res, &socket_uring.recv_msg, &msg, &payload, &payload_len) == 0) {
+			if (payload_len > sizeof (packet->buffer)) payload_len = sizeof (packet->buffer);
+			
+			memcpy (packet->buffer, payload, payload_len);
+			memset (&packet->src, 0, sizeof (packet->src));
+			memcpy (&packet->src, msg.msg_name, msg.msg_namelen);
+			packet->length = payload_len;
+			
+			_socket_parse_control (socket_uring.s, &msg, packet);
+			
+			ret = payload_len;
+			socket_uring.received++;
+		}
+		
+		uring_buffer_recycle (&socket_uring.buffers, bid);
+	}
+	
+	if (flags & IORING_CQE_F_MORE) return ret;
+	
+	/* El recvmsg multishot terminó. Con -ENOBUFS solo se acabaron los buffers, volver a armarlo */
+	if (res < 0 && res != -ENOBUFS) {
+		fprintf (stderr, "io_uring recvmsg: %s\n", strerror (-res));
+		
+		/* No volver a armarlo, ni reportar el fallo otra vez */
+		socket_uring.recv_stopped = 1;
+		
+		return -1;
 	}
 	
+	uring_recvmsg_multishot (socket_uring.ring, socket_uring.s, &socket_uring.recv_msg, &socket_uring.buffers, URING_TAG (URING_KIND_OSPF_RECV, 0));
+	
 	return ret;
 }
 
+static void _socket_uring_drain_cb (uint64_t user_data, int res, unsigned int flags, void *arg) {
+	socket_uring_complete (user_data, res, flags, (OSPFPacket *) arg);
+}
+
+void socket_uring_stop (void) {
+	OSPFPacket packet;
+	
+	if (socket_uring.ring == NULL) return;
+	
+	/* Esperar a que salgan los envíos encolados, como el último update antes de cerrar */
+	while (socket_uring.in_flight > 0) {
+		if (uring_submit (socket_uring.ring, 1) < 0) break;
+		
+		uring_reap (socket_uring.ring, _socket_uring_drain_cb, &packet);
+	}
+	
+	uring_buffers_destroy (socket_uring.ring, &socket_uring.buffers);
+	socket_uring.ring = NULL;
+}
+
+/* Recibir por el anillo AF_PACKET en lugar del socket raw.
+ * Debe llamarse antes de crear el enlace, para que socket_set_filter reparta los filtros */
+int socket_ring_start (PacketRing *ring, int s) {
+	memset (&socket_ring, 0, sizeof (socket_ring));
+	socket_ring.ring = ring;
+	
+	return _socket_ring_set_filter (s, NULL);
+}
+
+void socket_ring_stop (void) {
+	socket_ring.ring = NULL;
+}
+
+/* Convierte un datagrama IPv6 del anillo en un OSPFPacket con solo la carga OSPF,
+ * como lo entrega el socket raw. Devuelve el largo, o 0 si hay que ignorarlo */
+int socket_ring_packet (unsigned char *data, unsigned int len, int ifindex, struct timespec *stamp, OSPFPacket *packet) {
+	struct ipv6hdr *ip6;
+	unsigned int payload_len;
+	uint32_t sum;
+	
+	if (len < sizeof (struct ipv6hdr)) return 0;
+	
+	ip6 = (struct ipv6hdr *) data;
+	payload_len = ntohs (ip6->payload_len);
+	
+	if (ip6->nexthdr != 89) return 0;
+	
+	if (payload_len > len - sizeof (struct ipv6hdr) || payload_len > sizeof (packet->buffer)) return 0;
+	
+	/* Sin pasar por el socket raw, IPV6_CHECKSUM no revisa la suma, hacerlo aquí
+	 * con la pseudo-cabecera: origen, destino, largo y siguiente encabezado */
+	sum = csum_continue (0, &ip6->saddr, sizeof (struct in6_addr) * 2);
+	sum = csum_add32 (sum, htonl (payload_len));
+	sum = csum_add32 (sum, htonl (89));
+	sum = csum_continue (sum, data + sizeof (struct ipv6hdr), payload_len);
+	
+	if (csum_finish (sum) != 0) return 0;
+	
+	memcpy (packet->buffer, data + sizeof (struct ipv6hdr), payload_len);
+	packet->length = payload_len;
+	_socket_rx_time (packet, stamp);
+	
+	memset (&packet->src, 0, sizeof (packet->src));
+	packet->src.sin6_family = AF_INET6;
+	packet->src.sin6_scope_id = ifindex;
+	memcpy (&packet->src.sin6_addr, &ip6->saddr, sizeof (struct in6_addr));
+	
+	memset (&packet->dst, 0, sizeof (packet->dst));
+	memcpy (&packet->dst.sin6_addr, &ip6->daddr, sizeof (struct in6_addr));
+	
+	return payload_len;
+}
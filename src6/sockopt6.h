@@ -4,11 +4,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <sys/uio.h>
+
 #include "common6.h"
+#include "uring.h"
+#include "packet-ring.h"
+
+/* Paquetes por cada recvmmsg */
+#define SOCKET_RECV_BATCH 16
+
+/* Paquetes que caben en la cola de salida */
+#define SOCKET_SEND_QUEUE 64
+
+/* Segmentos extra, además de la cabecera, en cada socket_sendv */
+#define SOCKET_SEND_SEGMENTS 16
+
+/* Reintento de la cola de salida cuando el kernel responde EAGAIN, en milisegundos */
+#define SOCKET_SEND_RETRY 10
+
+/* Edad máxima que se cree de la marca de llegada del kernel, en milisegundos.
+ * Una edad mayor viene de un salto del reloj del sistema, no de la cola */
+#define SOCKET_RX_MAX_AGE 1000
 
 int socket_create (void);
 int socket_non_blocking (int s);
+int socket_set_buffers (int s, int rcvbuf, int sndbuf);
+int socket_set_priority (int s, int dscp, int priority);
+int socket_bind_device (int s, const char *iface_name);
+void socket_close (int s);
+unsigned long socket_rx_drops (void);
 ssize_t socket_send (int s, OSPFPacket *packet);
+ssize_t socket_send_ref (int s, OSPFPacket *packet);
+ssize_t socket_sendv (int s, OSPFPacket *packet, struct iovec *segments, int n_segments);
+OSPFPacket *socket_packet_new (void);
+void socket_packet_unref (OSPFPacket *packet);
+OSPFPacket *socket_packet_unshare (OSPFPacket *packet);
+int socket_flush (void);
+int socket_set_filter (int s, OSPFLink *ospf_link);
 ssize_t socket_recv (int s, OSPFPacket *packet);
+int socket_recv_batch (int s, OSPFPacket **packets);
+
+int socket_uring_start (URing *ring, int s);
+int socket_uring_complete (uint64_t user_data, int res, unsigned int flags, OSPFPacket *packet);
+void socket_uring_stop (void);
+void socket_uring_counters (unsigned long *received, unsigned long *sent);
+
+int socket_ring_start (PacketRing *ring, int s);
+void socket_ring_stop (void);
+int socket_ring_packet (unsigned char *data, unsigned int len, int ifindex, struct timespec *stamp, OSPFPacket *packet);
 
 #endif